@@ -0,0 +1,52 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIL_BINARY_H
+#define SIL_BINARY_H
+
+#include <sil/simage.h>
+
+/*
+ * Thresholds pack GRAY_8 or GRAY_16 samples straight into a BINARY image.
+ * Samples below the threshold become 1, black in PBM.
+ */
+simage_t *sil_image_threshold(const simage_t *src, uint16_t threshold);
+
+/*
+ * Otsu's threshold from the histogram of the image, or -1 if the
+ * histograms cannot be allocated
+ */
+int sil_image_otsu(const simage_t *src);
+simage_t *sil_image_threshold_otsu(const simage_t *src);
+
+/*
+ * Threshold each sample against the mean of the (2 * radius + 1) square
+ * window around it, clipped to the image, minus offset
+ */
+simage_t *sil_image_threshold_adaptive(const simage_t *src, size_t radius, int offset);
+
+// Bitwise operations on BINARY images of the same size
+simage_t *sil_image_and(const simage_t *a, const simage_t *b);
+simage_t *sil_image_or(const simage_t *a, const simage_t *b);
+simage_t *sil_image_xor(const simage_t *a, const simage_t *b);
+simage_t *sil_image_not(const simage_t *a);
+
+// Number of pixels set in a BINARY image
+uint64_t sil_image_popcount(const simage_t *img);
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIL_CACHE_H
+#define SIL_CACHE_H
+
+#include <sil/simage.h>
+
+struct scache;
+typedef struct scache scache_t;
+
+struct sil_cache_stats
+{
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t entries;
+    size_t bytes;
+};
+
+/*
+ * Cache of decoded PNM images keyed by path, inode, modification time and
+ * size, holding up to budget bytes of pixel data. Images returned by
+ * sil_cache_get are shared and read only; each one must be given back with
+ * sil_cache_release and stays valid until then, even if evicted.
+ */
+scache_t *sil_cache_new(size_t budget);
+void sil_cache_free(scache_t *cache);
+
+const simage_t *sil_cache_get(scache_t *cache, const char *path);
+void sil_cache_release(const simage_t *img);
+void sil_cache_stats(scache_t *cache, struct sil_cache_stats *stats);
+
+#endif
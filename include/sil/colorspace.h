@@ -0,0 +1,71 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIL_COLORSPACE_H
+#define SIL_COLORSPACE_H
+
+#include <sil/simage.h>
+
+enum sil_color_matrix
+{
+    SIL_COLOR_BT601,
+    SIL_COLOR_BT709
+};
+typedef enum sil_color_matrix smatrix_t;
+
+enum sil_color_range
+{
+    SIL_COLOR_FULL,
+    SIL_COLOR_LIMITED
+};
+typedef enum sil_color_range srange_t;
+
+enum sil_chroma
+{
+    SIL_CHROMA_444,
+    SIL_CHROMA_422,
+    SIL_CHROMA_420
+};
+typedef enum sil_chroma schroma_t;
+
+/*
+ * Planar Y, Cb and Cr buffers with their strides in bytes. Samples are
+ * uint8_t for RGB_24 images and host order uint16_t for RGB_48 images.
+ * Chroma planes are (width + 1) / 2 wide for 4:2:2 and 4:2:0, and
+ * (height + 1) / 2 high for 4:2:0.
+ */
+struct sil_planar
+{
+    void *plane[3];
+    size_t stride[3];
+};
+
+// Return 0, or -1 if the row buffers cannot be allocated
+int sil_image_to_ycbcr(const simage_t *src, struct sil_planar *dst,
+                       smatrix_t matrix, srange_t range, schroma_t chroma);
+int sil_image_from_ycbcr(const struct sil_planar *src, simage_t *dst,
+                         smatrix_t matrix, srange_t range, schroma_t chroma);
+
+/*
+ * HSV images are RGB_96F images holding hue, saturation and value in [0, 1].
+ * NULL if the image or the row buffers cannot be allocated.
+ */
+simage_t *sil_image_rgb_to_hsv(const simage_t *src);
+simage_t *sil_image_hsv_to_rgb(const simage_t *src, stype_t type);
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIL_COMPARE_H
+#define SIL_COMPARE_H
+
+#include <sil/simage.h>
+
+/*
+ * Errors are measured per channel sample in the units of the type: 0-255,
+ * 0-65535 or the normalized float value. Both images must have the same
+ * type and size; the byte order of 16-bit samples may differ. BINARY
+ * images can only be tested for equality.
+ */
+int sil_image_equal(const simage_t *a, const simage_t *b);
+simage_t *sil_image_absdiff(const simage_t *a, const simage_t *b);
+double sil_image_mse(const simage_t *a, const simage_t *b);
+double sil_image_psnr(const simage_t *a, const simage_t *b);
+double sil_image_max_error(const simage_t *a, const simage_t *b, size_t *x, size_t *y);
+
+#endif
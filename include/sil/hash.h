@@ -0,0 +1,43 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIL_HASH_H
+#define SIL_HASH_H
+
+#include <sil/simage.h>
+
+/*
+ * Non-cryptographic hash of the pixel content, type and size. Row padding,
+ * ROI offsets and the byte order of 16-bit samples do not change it. When
+ * the row copy of native 16-bit or binary images cannot be allocated the
+ * digest is all zero and errno is ENOMEM.
+ */
+uint64_t sil_image_hash(const simage_t *img);
+void sil_image_hash128(const simage_t *img, uint64_t *hash);
+
+/*
+ * Perceptual fingerprints computed on a downscaled luma image. Similar
+ * images give hashes with a small sil_hash_distance. When the row buffers
+ * cannot be allocated the hash is 0 and errno is ENOMEM; 0 is also a valid
+ * fingerprint, so clear errno first to tell them apart.
+ */
+uint64_t sil_image_phash(const simage_t *img);
+uint64_t sil_image_dhash(const simage_t *img);
+int sil_hash_distance(uint64_t a, uint64_t b);
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIL_INTEGRAL_H
+#define SIL_INTEGRAL_H
+
+#include <sil/simage.h>
+
+struct sintegral;
+typedef struct sintegral sintegral_t;
+
+/*
+ * Summed area table of a GRAY_8, GRAY_16, RGB_24 or RGB_48 image with one
+ * table per channel, optionally with the sums of the squared samples.
+ * Sums use 32-bit accumulators when they cannot overflow, 64-bit otherwise.
+ */
+sintegral_t *sil_image_integral(const simage_t *img, int squares);
+void sil_integral_free(sintegral_t *table);
+
+// Sums over the rectangle of width x height pixels at (x, y)
+uint64_t sil_integral_sum(const sintegral_t *table, size_t channel,
+                          size_t x, size_t y, size_t width, size_t height);
+uint64_t sil_integral_sqsum(const sintegral_t *table, size_t channel,
+                            size_t x, size_t y, size_t width, size_t height);
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIL_MORPHOLOGY_H
+#define SIL_MORPHOLOGY_H
+
+#include <sil/simage.h>
+
+/*
+ * Grayscale morphology on GRAY_8 images with a width x height rectangle
+ * anchored at (width / 2, height / 2); line elements are rectangles one
+ * pixel wide or high. The cost per pixel does not depend on the element
+ * size. Pixels outside the image count as 255 when eroding and 0 when
+ * dilating. Open and close reflect the element for their second step.
+ */
+simage_t *sil_image_erode(const simage_t *src, size_t width, size_t height);
+simage_t *sil_image_dilate(const simage_t *src, size_t width, size_t height);
+simage_t *sil_image_open(const simage_t *src, size_t width, size_t height);
+simage_t *sil_image_close(const simage_t *src, size_t width, size_t height);
+
+/*
+ * Arbitrary small elements given as a row-major width x height mask where
+ * non-zero entries are part of the element. The cost grows with the
+ * number of entries.
+ */
+simage_t *sil_image_erode_mask(const simage_t *src, const uint8_t *mask,
+                               size_t width, size_t height);
+simage_t *sil_image_dilate_mask(const simage_t *src, const uint8_t *mask,
+                                size_t width, size_t height);
+
+#endif
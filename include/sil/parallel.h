@@ -0,0 +1,60 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIL_PARALLEL_H
+#define SIL_PARALLEL_H
+
+#include <sil/simage.h>
+
+struct sil_parallel_opts
+{
+    // Rows or tiles per task, 0 picks a default
+    size_t grain;
+    // Tile size in pixels for sil_image_parallel_tiles, 0 picks a default
+    size_t tile_width;
+    size_t tile_height;
+};
+
+typedef void (*sil_range_fn)(size_t begin, size_t end, void *ctx);
+typedef void (*sil_rows_fn)(simage_t **imgs, size_t count,
+                            size_t top, size_t height, void *ctx);
+typedef void (*sil_tiles_fn)(simage_t **imgs, size_t count, size_t top, size_t left,
+                             size_t width, size_t height, void *ctx);
+
+/*
+ * The thread pool is started on first use with one thread per CPU. It can
+ * be set up beforehand with a given size (0 for one per CPU) and with the
+ * threads pinned to CPUs. Calls made from inside a task run serially.
+ */
+void sil_parallel_init(size_t threads, int affinity);
+void sil_parallel_shutdown(void);
+size_t sil_parallel_threads(void);
+
+// Run fn over [0, count) in chunks of at most grain items
+void sil_parallel_for(size_t count, size_t grain, sil_range_fn fn, void *ctx);
+
+/*
+ * Run fn over bands of rows (or tiles) of images of the same size. Band
+ * and tile limits keep every output row split on cache line boundaries.
+ */
+void sil_image_parallel_rows(simage_t **imgs, size_t count, sil_rows_fn fn, void *ctx,
+                             const struct sil_parallel_opts *opts);
+void sil_image_parallel_tiles(simage_t **imgs, size_t count, sil_tiles_fn fn, void *ctx,
+                              const struct sil_parallel_opts *opts);
+
+#endif
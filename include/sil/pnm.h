@@ -19,11 +19,42 @@
 #ifndef SIL_PNM_H
 #define SIL_PNM_H
 
+#include <sil/simage.h>
+
 #include <stdio.h>
 
 struct simage *sil_pnm_read_path(const char *path);
 struct simage *sil_pnm_read_stream(FILE *fd);
+struct simage *sil_pnm_read_path_order(const char *path, sorder_t order);
+struct simage *sil_pnm_read_stream_order(FILE *fd, sorder_t order);
 void sil_pnm_write_path(const struct simage *img, const char *path);
 void sil_pnm_write_stream(const struct simage *img, FILE *fd);
 
+// Flags for sil_pnm_write_path_parallel
+#define SIL_PNM_DIRECT 1
+
+/*
+ * Write img to path from several threads (0 uses one per CPU), each one
+ * storing file chunks at their offsets with pwrite.
+ */
+void sil_pnm_write_path_parallel(const struct simage *img, const char *path, size_t threads, int flags);
+
+/*
+ * In place update of an existing P4/P5/P6 file. Rows are read on demand with
+ * sil_pnm_update_load, modified through the image and marked dirty; commit
+ * writes back only the dirty byte ranges. Close commits pending changes.
+ * Rows that are not loaded may be marked in several places, but P4 marks
+ * that do not start and end on a byte need the row loaded.
+ */
+struct pnm_update;
+typedef struct pnm_update supdate_t;
+
+supdate_t *sil_pnm_update_open(const char *path);
+struct simage *sil_pnm_update_image(supdate_t *u);
+void sil_pnm_update_load(supdate_t *u, size_t top, size_t height);
+void sil_pnm_update_mark(supdate_t *u, size_t top, size_t left, size_t width, size_t height);
+void sil_pnm_update_mark_rows(supdate_t *u, size_t top, size_t height);
+void sil_pnm_update_commit(supdate_t *u);
+void sil_pnm_update_close(supdate_t *u);
+
 #endif
@@ -30,21 +30,72 @@ enum sil_image_type
     SIL_IMAGE_GRAY_8,
     SIL_IMAGE_GRAY_16,
     SIL_IMAGE_RGB_24,
-    SIL_IMAGE_RGB_48
+    SIL_IMAGE_RGB_48,
+    SIL_IMAGE_RGBA_32,
+    SIL_IMAGE_GRAY_32F,
+    SIL_IMAGE_RGB_96F,
+    // 1 bit per pixel packed MSB first as in PBM, where 1 is black
+    SIL_IMAGE_BINARY
 };
 typedef enum sil_image_type stype_t;
 
+/*
+ * Byte order of the GRAY_16 and RGB_48 samples. Images are created in the
+ * big-endian PNM layout; in native order sil_image_data_row16 returns
+ * samples ready for arithmetic and the PNM I/O swaps bytes on the fly.
+ */
+enum sil_image_order
+{
+    SIL_IMAGE_ORDER_BIG,
+    SIL_IMAGE_ORDER_NATIVE
+};
+typedef enum sil_image_order sorder_t;
+
+// Access hints for the rows of a mapped image
+enum sil_image_advice
+{
+    SIL_IMAGE_ADVICE_NORMAL,
+    SIL_IMAGE_ADVICE_SEQUENTIAL,
+    SIL_IMAGE_ADVICE_RANDOM,
+    SIL_IMAGE_ADVICE_WILLNEED,
+    SIL_IMAGE_ADVICE_DONTNEED
+};
+typedef enum sil_image_advice sadvice_t;
+
 simage_t *sil_image_new(size_t width, size_t height, stype_t type);
 simage_t *sil_image_zero_new(size_t width, size_t height, stype_t type);
 simage_t *sil_image_copy(const simage_t *src);
 
+/*
+ * Create an image backed by a sparse memory mapped file at path. For the
+ * PNM types the file is a valid P5/P6 image once the pixels are written
+ * (keep the big-endian order for 16-bit samples). Advice and sync are
+ * no-ops on heap images.
+ */
+simage_t *sil_image_new_mapped(const char *path, size_t width, size_t height, stype_t type);
+int sil_image_advise(simage_t *img, size_t y, size_t rows, sadvice_t advice);
+int sil_image_sync(simage_t *img, int wait);
+simage_t *sil_image_convert(const simage_t *src, stype_t type);
+
+// Returns 0, or -1 if the scratch row of a float conversion cannot be allocated
+int sil_image_convert_row(const simage_t *src, size_t src_y, simage_t *dst, size_t dst_y);
+
+simage_t *sil_image_ref(simage_t *img);
 void sil_image_free(simage_t *img);
 void sil_image_roi(simage_t *img, size_t top, size_t left, size_t width, size_t height);
 void sil_image_zero(simage_t *img);
+void sil_image_set_order(simage_t *img, sorder_t order);
 
 void sil_image_set_pixel(simage_t *img, size_t x, size_t y, uint64_t value);
 uint64_t sil_image_get_pixel(const simage_t *img, size_t x, size_t y);
 
+/*
+ * Channel values are normalized to [0, 1] for every type. These are the
+ * only accessors available for the float types.
+ */
+void sil_image_set_pixelf(simage_t *img, size_t x, size_t y, const float *value);
+void sil_image_get_pixelf(const simage_t *img, size_t x, size_t y, float *value);
+
 uint8_t *sil_image_data8(const simage_t *img);
 uint16_t *sil_image_data16(const simage_t *img);
 uint32_t *sil_image_data32(const simage_t *img);
@@ -52,11 +103,16 @@ uint32_t *sil_image_data32(const simage_t *img);
 uint8_t *sil_image_data_row8(const simage_t *img, size_t y);
 uint16_t *sil_image_data_row16(const simage_t *img, size_t y);
 uint32_t *sil_image_data_row32(const simage_t *img, size_t y);
+float *sil_image_data_rowf(const simage_t *img, size_t y);
 
 size_t sil_image_get_width(const simage_t *img);
 size_t sil_image_get_height(const simage_t *img);
 size_t sil_image_get_stride(const simage_t *img);
 size_t sil_image_byte_per_pixel(const simage_t *img);
+// Bytes of pixel data in a row, BINARY images have 0 bytes per pixel
+size_t sil_image_get_row_bytes(const simage_t *img);
+size_t sil_image_get_channels(const simage_t *img);
 stype_t sil_image_get_type(const simage_t *img);
+sorder_t sil_image_get_order(const simage_t *img);
 
 #endif
@@ -0,0 +1,512 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sil/binary.h>
+#include <sil/integral.h>
+#include <sil/parallel.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+enum op
+{
+    OP_AND,
+    OP_OR,
+    OP_XOR,
+    OP_NOT
+};
+
+struct job
+{
+    const simage_t *src;
+    const simage_t *other;
+    simage_t *dst;
+    const sintegral_t *table;
+    enum op op;
+    uint16_t threshold;
+    size_t radius;
+    int offset;
+    size_t grain;
+    uint64_t *histogram;
+    uint64_t count;
+    int failed;
+};
+
+static size_t band_rows(const simage_t *img)
+{
+    return BAND_BYTES / (sil_image_get_row_bytes(img) + 1) + 1;
+}
+
+static void check_gray(const simage_t *src)
+{
+    assert (sil_image_get_type(src) == SIL_IMAGE_GRAY_8
+        || sil_image_get_type(src) == SIL_IMAGE_GRAY_16);
+}
+
+/*
+ * Pack eight comparisons per output byte. The inner loop has a fixed
+ * trip count so the compiler unrolls it into vector compares; the tail
+ * byte is padded with zero bits.
+ */
+static void pack_u8(const uint8_t *in, size_t count, uint16_t threshold, uint8_t *out)
+{
+    size_t full = count / 8;
+    for (size_t i = 0; i < full; ++i)
+    {
+        uint8_t bits = 0;
+        for (size_t k = 0; k < 8; ++k)
+            bits |= (in[8 * i + k] < threshold) << (7 - k);
+        out[i] = bits;
+    }
+
+    if (count % 8)
+    {
+        uint8_t bits = 0;
+        for (size_t k = 0; k < count % 8; ++k)
+            bits |= (in[8 * full + k] < threshold) << (7 - k);
+        out[full] = bits;
+    }
+}
+
+static void pack_u16(const uint16_t *in, size_t count, uint16_t threshold, uint8_t *out)
+{
+    size_t full = count / 8;
+    for (size_t i = 0; i < full; ++i)
+    {
+        uint8_t bits = 0;
+        for (size_t k = 0; k < 8; ++k)
+            bits |= (in[8 * i + k] < threshold) << (7 - k);
+        out[i] = bits;
+    }
+
+    if (count % 8)
+    {
+        uint8_t bits = 0;
+        for (size_t k = 0; k < count % 8; ++k)
+            bits |= (in[8 * full + k] < threshold) << (7 - k);
+        out[full] = bits;
+    }
+}
+
+// Run fn over row bands of height rows, NULL and the image freed on failure
+static simage_t *run(struct job *job, size_t width, size_t height, size_t grain, sil_range_fn fn)
+{
+    simage_t *dst = sil_image_new(width, height, SIL_IMAGE_BINARY);
+    if (!dst)
+        return NULL;
+
+    job->dst = dst;
+    job->failed = 0;
+    sil_parallel_for(height, grain, fn, job);
+
+    if (job->failed)
+    {
+        sil_image_free(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+static void threshold_band(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    const simage_t *src = job->src;
+    size_t width = sil_image_get_width(src);
+
+    if (sil_image_get_type(src) == SIL_IMAGE_GRAY_8)
+    {
+        for (size_t y = begin; y < end; ++y)
+            pack_u8(sil_image_data_row8(src, y), width, job->threshold,
+                    sil_image_data_row8(job->dst, y));
+        return;
+    }
+
+    uint16_t *buf = (uint16_t *) malloc (sizeof(uint16_t) * width);
+    if (!buf)
+    {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    for (size_t y = begin; y < end; ++y)
+        pack_u16(load_row16(src, y, buf, width), width, job->threshold,
+                 sil_image_data_row8(job->dst, y));
+    free (buf);
+}
+
+simage_t *sil_image_threshold(const simage_t *src, uint16_t threshold)
+{
+    check_gray(src);
+
+    struct job job;
+    memset(&job, 0, sizeof(job));
+    job.src = src;
+    job.threshold = threshold;
+    return run(&job, sil_image_get_width(src), sil_image_get_height(src),
+               band_rows(src), threshold_band);
+}
+
+/*
+ * Each band counts into its own histogram, there is one band per thread so
+ * they are merged once at the end
+ */
+static void histogram_band(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    const simage_t *src = job->src;
+    size_t width = sil_image_get_width(src);
+    int wide = sil_image_get_type(src) == SIL_IMAGE_GRAY_16;
+    uint64_t *histogram = job->histogram + begin / job->grain * (wide ? 65536 : 256);
+
+    if (!wide)
+    {
+        for (size_t y = begin; y < end; ++y)
+        {
+            const uint8_t *row = sil_image_data_row8(src, y);
+            for (size_t i = 0; i < width; ++i)
+                ++histogram[row[i]];
+        }
+        return;
+    }
+
+    uint16_t *buf = (uint16_t *) malloc (sizeof(uint16_t) * width);
+    if (!buf)
+    {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    for (size_t y = begin; y < end; ++y)
+    {
+        const uint16_t *row = load_row16(src, y, buf, width);
+        for (size_t i = 0; i < width; ++i)
+            ++histogram[row[i]];
+    }
+    free (buf);
+}
+
+int sil_image_otsu(const simage_t *src)
+{
+    check_gray(src);
+
+    size_t height = sil_image_get_height(src);
+    size_t threads = sil_parallel_threads();
+    size_t bins = sil_image_get_type(src) == SIL_IMAGE_GRAY_16 ? 65536 : 256;
+
+    struct job job;
+    memset(&job, 0, sizeof(job));
+    job.src = src;
+    job.grain = (height + threads - 1) / threads;
+    if (!job.grain)
+        job.grain = 1;
+    size_t bands = (height + job.grain - 1) / job.grain;
+
+    job.histogram = (uint64_t *) calloc(bands * bins, sizeof(uint64_t));
+    if (!job.histogram)
+        return -1;
+
+    sil_parallel_for(height, job.grain, histogram_band, &job);
+    if (job.failed)
+    {
+        free (job.histogram);
+        return -1;
+    }
+
+    uint64_t *histogram = job.histogram;
+    for (size_t k = 1; k < bands; ++k)
+        for (size_t i = 0; i < bins; ++i)
+            histogram[i] += histogram[k * bins + i];
+
+    double total = 0, sum = 0;
+    for (size_t i = 0; i < bins; ++i)
+    {
+        total += histogram[i];
+        sum += (double) i * histogram[i];
+    }
+
+    /*
+     * Maximize the between class variance of the samples below t and the
+     * rest, keeping the first maximum
+     */
+    double below = 0, below_sum = 0, best = -1;
+    int threshold = 0;
+    for (size_t t = 1; t < bins; ++t)
+    {
+        below += histogram[t - 1];
+        below_sum += (double) (t - 1) * histogram[t - 1];
+        if (below == 0 || below == total)
+            continue;
+
+        double mean_below = below_sum / below;
+        double mean_above = (sum - below_sum) / (total - below);
+        double d = mean_below - mean_above;
+        double variance = below * (total - below) * d * d;
+        if (variance > best)
+        {
+            best = variance;
+            threshold = (int) t;
+        }
+    }
+
+    free (job.histogram);
+    return threshold;
+}
+
+simage_t *sil_image_threshold_otsu(const simage_t *src)
+{
+    int threshold = sil_image_otsu(src);
+    if (threshold < 0)
+        return NULL;
+    return sil_image_threshold(src, (uint16_t) threshold);
+}
+
+/*
+ * Flags of the samples at or above the mean of their window, read from the
+ * table rows at the top and bottom of the window. Compared as
+ * sample * area >= sum - offset * area to stay in integers. Windows clipped
+ * by the left or right border take the clamped loop, the rest a flat one
+ * with a constant area.
+ */
+static void adaptive_u32(const uint32_t *top, const uint32_t *bottom, const uint16_t *row,
+                         size_t width, size_t r, int64_t rows, int64_t offset, uint8_t *flags)
+{
+    size_t first = r < width ? r : width;
+    size_t last = width > r ? width - r : 0;
+    if (last < first)
+        last = first;
+
+    for (size_t x = 0; x < width; x = x + 1 == first ? last : x + 1)
+    {
+        size_t left = x > r ? x - r : 0;
+        size_t right = x + r + 1 < width ? x + r + 1 : width;
+        int64_t area = (int64_t) (right - left) * rows;
+        int64_t sum = (uint32_t) (bottom[right] - bottom[left] - top[right] + top[left]);
+        flags[x] = (int64_t) row[x] * area >= sum - offset * area;
+    }
+
+    int64_t area = (int64_t) (2 * r + 1) * rows;
+    for (size_t x = first; x < last; ++x)
+    {
+        int64_t sum = (uint32_t) (bottom[x + r + 1] - bottom[x - r] - top[x + r + 1] + top[x - r]);
+        flags[x] = (int64_t) row[x] * area >= sum - offset * area;
+    }
+}
+
+static void adaptive_u64(const uint64_t *top, const uint64_t *bottom, const uint16_t *row,
+                         size_t width, size_t r, int64_t rows, int64_t offset, uint8_t *flags)
+{
+    size_t first = r < width ? r : width;
+    size_t last = width > r ? width - r : 0;
+    if (last < first)
+        last = first;
+
+    for (size_t x = 0; x < width; x = x + 1 == first ? last : x + 1)
+    {
+        size_t left = x > r ? x - r : 0;
+        size_t right = x + r + 1 < width ? x + r + 1 : width;
+        int64_t area = (int64_t) (right - left) * rows;
+        int64_t sum = (int64_t) (bottom[right] - bottom[left] - top[right] + top[left]);
+        flags[x] = (int64_t) row[x] * area >= sum - offset * area;
+    }
+
+    int64_t area = (int64_t) (2 * r + 1) * rows;
+    for (size_t x = first; x < last; ++x)
+    {
+        int64_t sum = (int64_t) (bottom[x + r + 1] - bottom[x - r] - top[x + r + 1] + top[x - r]);
+        flags[x] = (int64_t) row[x] * area >= sum - offset * area;
+    }
+}
+
+static void adaptive_band(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    const simage_t *src = job->src;
+    size_t width = sil_image_get_width(src);
+    size_t height = sil_image_get_height(src);
+    size_t r = job->radius;
+
+    uint16_t *buf = (uint16_t *) malloc ((sizeof(uint16_t) + 1) * width);
+    if (!buf)
+    {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    uint8_t *flags = (uint8_t *) (buf + width);
+
+    for (size_t y = begin; y < end; ++y)
+    {
+        const uint16_t *row;
+        if (sil_image_get_type(src) == SIL_IMAGE_GRAY_8)
+        {
+            const uint8_t *row8 = sil_image_data_row8(src, y);
+            for (size_t i = 0; i < width; ++i)
+                buf[i] = row8[i];
+            row = buf;
+        }
+        else
+            row = load_row16(src, y, buf, width);
+
+        size_t top = y > r ? y - r : 0;
+        size_t bottom = y + r + 1 < height ? y + r + 1 : height;
+        int wide;
+        const void *up = sil_integral_row(job->table, top, &wide);
+        const void *down = sil_integral_row(job->table, bottom, &wide);
+
+        if (wide)
+            adaptive_u64((const uint64_t *) up, (const uint64_t *) down, row, width, r,
+                         (int64_t) (bottom - top), job->offset, flags);
+        else
+            adaptive_u32((const uint32_t *) up, (const uint32_t *) down, row, width, r,
+                         (int64_t) (bottom - top), job->offset, flags);
+
+        // The flags are 0 for the samples below the mean, packed as 1
+        pack_u8(flags, width, 1, sil_image_data_row8(job->dst, y));
+    }
+
+    free (buf);
+}
+
+simage_t *sil_image_threshold_adaptive(const simage_t *src, size_t radius, int offset)
+{
+    check_gray(src);
+
+    sintegral_t *table = sil_image_integral(src, 0);
+    if (!table)
+        return NULL;
+
+    struct job job;
+    memset(&job, 0, sizeof(job));
+    job.src = src;
+    job.table = table;
+    job.radius = radius;
+    job.offset = offset;
+    simage_t *dst = run(&job, sil_image_get_width(src), sil_image_get_height(src),
+                        band_rows(src), adaptive_band);
+
+    sil_integral_free(table);
+    return dst;
+}
+
+// Flat byte loops the compiler vectorizes, bits past the width are cleared
+static void bitwise_band(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    size_t bytes = sil_image_get_row_bytes(job->src);
+    uint8_t mask = tail_mask(sil_image_get_width(job->src));
+
+    for (size_t y = begin; y < end; ++y)
+    {
+        const uint8_t *a = sil_image_data_row8(job->src, y);
+        const uint8_t *b = job->other ? sil_image_data_row8(job->other, y) : a;
+        uint8_t *d = sil_image_data_row8(job->dst, y);
+
+        switch (job->op)
+        {
+            case OP_AND:
+                for (size_t i = 0; i < bytes; ++i)
+                    d[i] = a[i] & b[i];
+                break;
+            case OP_OR:
+                for (size_t i = 0; i < bytes; ++i)
+                    d[i] = a[i] | b[i];
+                break;
+            case OP_XOR:
+                for (size_t i = 0; i < bytes; ++i)
+                    d[i] = a[i] ^ b[i];
+                break;
+            case OP_NOT:
+                for (size_t i = 0; i < bytes; ++i)
+                    d[i] = ~a[i];
+                break;
+        }
+        d[bytes - 1] &= mask;
+    }
+}
+
+static simage_t *bitwise(const simage_t *a, const simage_t *b, enum op op)
+{
+    assert (sil_image_get_type(a) == SIL_IMAGE_BINARY);
+    assert (!b || (sil_image_get_type(b) == SIL_IMAGE_BINARY
+                   && sil_image_get_width(a) == sil_image_get_width(b)
+                   && sil_image_get_height(a) == sil_image_get_height(b)));
+
+    struct job job;
+    memset(&job, 0, sizeof(job));
+    job.src = a;
+    job.other = b;
+    job.op = op;
+    return run(&job, sil_image_get_width(a), sil_image_get_height(a),
+               band_rows(a), bitwise_band);
+}
+
+simage_t *sil_image_and(const simage_t *a, const simage_t *b)
+{
+    return bitwise(a, b, OP_AND);
+}
+
+simage_t *sil_image_or(const simage_t *a, const simage_t *b)
+{
+    return bitwise(a, b, OP_OR);
+}
+
+simage_t *sil_image_xor(const simage_t *a, const simage_t *b)
+{
+    return bitwise(a, b, OP_XOR);
+}
+
+simage_t *sil_image_not(const simage_t *a)
+{
+    return bitwise(a, NULL, OP_NOT);
+}
+
+// Whole 64-bit words go through the hardware popcount, the tail by bytes
+static void popcount_band(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    size_t bytes = sil_image_get_row_bytes(job->src);
+    uint8_t mask = tail_mask(sil_image_get_width(job->src));
+    uint64_t count = 0;
+
+    for (size_t y = begin; y < end; ++y)
+    {
+        const uint8_t *row = sil_image_data_row8(job->src, y);
+        size_t words = (bytes - 1) / 8;
+        for (size_t i = 0; i < words; ++i)
+        {
+            uint64_t w;
+            memcpy(&w, row + 8 * i, sizeof(w));
+            count += __builtin_popcountll(w);
+        }
+        for (size_t i = words * 8; i < bytes - 1; ++i)
+            count += __builtin_popcount(row[i]);
+        count += __builtin_popcount(row[bytes - 1] & mask);
+    }
+
+    __atomic_add_fetch(&job->count, count, __ATOMIC_RELAXED);
+}
+
+uint64_t sil_image_popcount(const simage_t *img)
+{
+    assert (sil_image_get_type(img) == SIL_IMAGE_BINARY);
+
+    struct job job;
+    memset(&job, 0, sizeof(job));
+    job.src = img;
+    sil_parallel_for(sil_image_get_height(img), band_rows(img), popcount_band, &job);
+    return job.count;
+}
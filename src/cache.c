@@ -0,0 +1,333 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sil/cache.h>
+#include <sil/pnm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// Lookups on different shards never contend for the same lock
+#define SHARDS 16
+#define BUCKETS 256
+
+struct entry
+{
+    char *path;
+    uint64_t hash;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+    simage_t *img;
+    size_t bytes;
+    int referenced;
+    // Hash bucket chain and CLOCK ring
+    struct entry *next;
+    struct entry *ring_prev;
+    struct entry *ring_next;
+};
+
+struct shard
+{
+    pthread_mutex_t lock;
+    struct entry *buckets[BUCKETS];
+    struct entry *hand;
+    size_t bytes;
+    size_t entries;
+};
+
+struct scache
+{
+    struct shard shards[SHARDS];
+    size_t budget;
+    // Bytes of all shards, updated under the lock of the shard that changed
+    size_t bytes;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+};
+
+static uint64_t hash_path(const char *path)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; *path; ++path)
+        h = (h ^ (uint8_t) *path) * 0x100000001b3ULL;
+    return h;
+}
+
+static int same_file(const struct entry *e, const struct stat *st)
+{
+    return e->dev == st->st_dev
+        && e->ino == st->st_ino
+        && e->size == st->st_size
+        && e->mtime.tv_sec == st->st_mtim.tv_sec
+        && e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static struct entry **find(struct shard *shard, uint64_t hash, const char *path)
+{
+    struct entry **link = &shard->buckets[(hash / SHARDS) % BUCKETS];
+    while (*link && ((*link)->hash != hash || strcmp((*link)->path, path) != 0))
+        link = &(*link)->next;
+    return link;
+}
+
+// Unlink the entry at link and drop the cache reference to its image
+static void remove_entry(scache_t *cache, struct shard *shard, struct entry **link)
+{
+    struct entry *e = *link;
+    *link = e->next;
+
+    if (e->ring_next == e)
+        shard->hand = NULL;
+    else
+    {
+        e->ring_prev->ring_next = e->ring_next;
+        e->ring_next->ring_prev = e->ring_prev;
+        if (shard->hand == e)
+            shard->hand = e->ring_next;
+    }
+
+    shard->bytes -= e->bytes;
+    --shard->entries;
+    __atomic_sub_fetch(&cache->bytes, e->bytes, __ATOMIC_RELAXED);
+    sil_image_free(e->img);
+    free (e->path);
+    free (e);
+}
+
+static void insert_entry(scache_t *cache, struct shard *shard, struct entry *e)
+{
+    struct entry **bucket = &shard->buckets[(e->hash / SHARDS) % BUCKETS];
+    e->next = *bucket;
+    *bucket = e;
+
+    // New entries go behind the hand, the last place it will look
+    if (!shard->hand)
+    {
+        e->ring_prev = e->ring_next = e;
+        shard->hand = e;
+    }
+    else
+    {
+        e->ring_next = shard->hand;
+        e->ring_prev = shard->hand->ring_prev;
+        e->ring_prev->ring_next = e;
+        shard->hand->ring_prev = e;
+    }
+
+    shard->bytes += e->bytes;
+    ++shard->entries;
+    __atomic_add_fetch(&cache->bytes, e->bytes, __ATOMIC_RELAXED);
+}
+
+static int over_budget(scache_t *cache)
+{
+    return __atomic_load_n(&cache->bytes, __ATOMIC_RELAXED) > cache->budget;
+}
+
+static void evict_entry(scache_t *cache, struct shard *shard, struct entry *e)
+{
+    remove_entry(cache, shard, find(shard, e->hash, e->path));
+    __atomic_add_fetch(&cache->evictions, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * One turn of the CLOCK hand of a shard: referenced entries get a second
+ * chance, the others are evicted until the cache fits its budget
+ */
+static void sweep(scache_t *cache, struct shard *shard, const struct entry *keep)
+{
+    for (size_t n = shard->entries; n > 0 && shard->hand && over_budget(cache); --n)
+    {
+        struct entry *e = shard->hand;
+        if (e->referenced || e == keep)
+        {
+            e->referenced = 0;
+            shard->hand = e->ring_next;
+        }
+        else
+            evict_entry(cache, shard, e);
+    }
+}
+
+/*
+ * The budget is shared by all shards. The hand sweeps them in turn from
+ * the one that grew, sparing the entry just inserted; two rounds clear and
+ * then evict entries referenced before. Shard locks are taken one at a
+ * time, so inserts into different shards cannot deadlock.
+ */
+static void evict(scache_t *cache, uint64_t hash, const struct entry *keep)
+{
+    size_t first = hash % SHARDS;
+    for (int round = 0; round < 2 && over_budget(cache); ++round)
+    {
+        for (size_t i = 0; i < SHARDS && over_budget(cache); ++i)
+        {
+            struct shard *shard = &cache->shards[(first + i) % SHARDS];
+            pthread_mutex_lock(&shard->lock);
+            sweep(cache, shard, keep);
+            pthread_mutex_unlock(&shard->lock);
+        }
+    }
+
+    // An image larger than the whole budget is not kept either
+    struct shard *shard = &cache->shards[first];
+    pthread_mutex_lock(&shard->lock);
+    if (over_budget(cache))
+    {
+        struct entry **link = &shard->buckets[(hash / SHARDS) % BUCKETS];
+        while (*link && *link != keep)
+            link = &(*link)->next;
+        if (*link)
+            evict_entry(cache, shard, *link);
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+scache_t *sil_cache_new(size_t budget)
+{
+    scache_t *cache = (scache_t *) calloc(1, sizeof(scache_t));
+    if (!cache)
+        return NULL;
+
+    cache->budget = budget;
+    for (int i = 0; i < SHARDS; ++i)
+        pthread_mutex_init(&cache->shards[i].lock, NULL);
+
+    return cache;
+}
+
+void sil_cache_free(scache_t *cache)
+{
+    for (int i = 0; i < SHARDS; ++i)
+    {
+        struct shard *shard = &cache->shards[i];
+        for (int j = 0; j < BUCKETS; ++j)
+        {
+            while (shard->buckets[j])
+                remove_entry(cache, shard, &shard->buckets[j]);
+        }
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free (cache);
+}
+
+const simage_t *sil_cache_get(scache_t *cache, const char *path)
+{
+    // Hits only stat the path
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return NULL;
+
+    uint64_t hash = hash_path(path);
+    struct shard *shard = &cache->shards[hash % SHARDS];
+
+    pthread_mutex_lock(&shard->lock);
+    struct entry **link = find(shard, hash, path);
+    if (*link && same_file(*link, &st))
+    {
+        (*link)->referenced = 1;
+        simage_t *img = sil_image_ref((*link)->img);
+        pthread_mutex_unlock(&shard->lock);
+        __atomic_add_fetch(&cache->hits, 1, __ATOMIC_RELAXED);
+        return img;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    __atomic_add_fetch(&cache->misses, 1, __ATOMIC_RELAXED);
+
+    /*
+     * On a miss the key comes from the open file that is decoded, so a file
+     * replaced meanwhile can never be cached under the key of the old one
+     */
+    FILE *fd = fopen(path, "r");
+    if (!fd)
+        return NULL;
+    if (fstat(fileno(fd), &st) != 0)
+    {
+        fclose(fd);
+        return NULL;
+    }
+
+    // The image is decoded without holding the shard lock
+    struct entry *e = (struct entry *) malloc (sizeof(struct entry));
+    char *copy = strdup(path);
+    if (!e || !copy)
+    {
+        free (e);
+        free (copy);
+        fclose(fd);
+        return NULL;
+    }
+
+    e->path = copy;
+    e->hash = hash;
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->mtime = st.st_mtim;
+    e->size = st.st_size;
+    e->img = sil_pnm_read_stream(fd);
+    fclose(fd);
+    e->bytes = sil_image_get_stride(e->img) * sil_image_get_height(e->img);
+    e->referenced = 1;
+
+    // Replace whatever was there, another thread may have loaded it meanwhile
+    pthread_mutex_lock(&shard->lock);
+    link = find(shard, hash, path);
+    if (*link)
+        remove_entry(cache, shard, link);
+    insert_entry(cache, shard, e);
+    simage_t *img = sil_image_ref(e->img);
+    pthread_mutex_unlock(&shard->lock);
+
+    /*
+     * Once the lock is released the entry may be replaced by another
+     * thread; evict only compares its address and never reads it
+     */
+    if (over_budget(cache))
+        evict(cache, hash, e);
+
+    return img;
+}
+
+void sil_cache_release(const simage_t *img)
+{
+    sil_image_free((simage_t *) img);
+}
+
+void sil_cache_stats(scache_t *cache, struct sil_cache_stats *stats)
+{
+    stats->hits = __atomic_load_n(&cache->hits, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&cache->misses, __ATOMIC_RELAXED);
+    stats->evictions = __atomic_load_n(&cache->evictions, __ATOMIC_RELAXED);
+    stats->entries = 0;
+    stats->bytes = 0;
+
+    for (int i = 0; i < SHARDS; ++i)
+    {
+        struct shard *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        stats->entries += shard->entries;
+        stats->bytes += shard->bytes;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
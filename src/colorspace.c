@@ -0,0 +1,565 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sil/colorspace.h>
+#include <sil/parallel.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+/*
+ * Fixed point precision of the conversion matrices. 8-bit samples use a
+ * shorter one so the products fit in int32_t.
+ */
+#define SHIFT 16
+#define SHIFT8 14
+
+// Pixels of each row band, smaller images are converted by the calling thread
+#define BAND_PIXELS (1 << 16)
+
+struct coefs
+{
+    int32_t m[3][3];
+    int64_t off[3];
+    int32_t max;
+};
+
+struct job
+{
+    const simage_t *src_img;
+    simage_t *dst_img;
+    const struct sil_planar *src_planes;
+    const struct sil_planar *dst_planes;
+    struct coefs coefs;
+    schroma_t chroma;
+    size_t y0;
+    size_t y1;
+    int failed;
+};
+
+static void luma_weights(smatrix_t matrix, double *kr, double *kb)
+{
+    *kr = matrix == SIL_COLOR_BT709 ? 0.2126 : 0.299;
+    *kb = matrix == SIL_COLOR_BT709 ? 0.0722 : 0.114;
+}
+
+/*
+ * Range scaling: limited range maps luma to [16, 235] and chroma to
+ * [16, 240] in 8-bit units, scaled by 256 for 16-bit samples.
+ */
+static void range_scale(srange_t range, int64_t max, double *ys, double *cs, double *yoff, double *coff)
+{
+    double unit = (max + 1) / 256.0;
+    *ys = 1.0;
+    *cs = 1.0;
+    *yoff = 0.0;
+    *coff = 128.0 * unit;
+    if (range == SIL_COLOR_LIMITED)
+    {
+        *ys = 219.0 * unit / max;
+        *cs = 224.0 * unit / max;
+        *yoff = 16.0 * unit;
+    }
+}
+
+static void forward_coefs(smatrix_t matrix, srange_t range, int64_t max, struct coefs *c)
+{
+    double kr, kb, ys, cs, yoff, coff;
+    luma_weights(matrix, &kr, &kb);
+    range_scale(range, max, &ys, &cs, &yoff, &coff);
+    double kg = 1.0 - kr - kb;
+
+    double m[3][3] = {
+        {kr * ys, kg * ys, kb * ys},
+        {-kr / (2 * (1 - kb)) * cs, -kg / (2 * (1 - kb)) * cs, 0.5 * cs},
+        {0.5 * cs, -kg / (2 * (1 - kr)) * cs, -kb / (2 * (1 - kr)) * cs}};
+    double off[3] = {yoff, coff, coff};
+
+    // Offsets include the rounding term of the final shift
+    int shift = max == 255 ? SHIFT8 : SHIFT;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+            c->m[i][j] = llround(m[i][j] * (1 << shift));
+        c->off[i] = llround(off[i] * (1 << shift)) + (1 << (shift - 1));
+    }
+    c->max = max;
+}
+
+// The offsets of the inverse are subtracted from Y, Cb and Cr before the matrix
+static void inverse_coefs(smatrix_t matrix, srange_t range, int64_t max, struct coefs *c)
+{
+    double kr, kb, ys, cs, yoff, coff;
+    luma_weights(matrix, &kr, &kb);
+    range_scale(range, max, &ys, &cs, &yoff, &coff);
+    double kg = 1.0 - kr - kb;
+
+    double m[3][3] = {
+        {1 / ys, 0, 2 * (1 - kr) / cs},
+        {1 / ys, -2 * kb * (1 - kb) / kg / cs, -2 * kr * (1 - kr) / kg / cs},
+        {1 / ys, 2 * (1 - kb) / cs, 0}};
+
+    int shift = max == 255 ? SHIFT8 : SHIFT;
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            c->m[i][j] = llround(m[i][j] * (1 << shift));
+    c->off[0] = llround(yoff);
+    c->off[1] = llround(coff);
+    c->off[2] = llround(coff);
+    c->max = max;
+}
+
+static inline int32_t clamp32(int32_t v, int32_t max)
+{
+    return v < 0 ? 0 : v > max ? max : v;
+}
+
+static inline int64_t clamp64(int64_t v, int64_t max)
+{
+    return v < 0 ? 0 : v > max ? max : v;
+}
+
+static int is_16bit(const simage_t *img)
+{
+    return sil_image_get_type(img) == SIL_IMAGE_RGB_48;
+}
+
+static inline void *plane_row(const struct sil_planar *p, int plane, size_t y)
+{
+    return (uint8_t *) p->plane[plane] + p->stride[plane] * y;
+}
+
+/*
+ * Fixed point matrix over a row of RGB triplets, writing luma to its plane
+ * row and chroma to the buffers averaged by the caller. The coefficients
+ * are copied to the stack so the stores cannot alias them.
+ */
+static void forward_u8(const struct coefs *c, const uint8_t *rgb, uint8_t *luma,
+                       int32_t *cb, int32_t *cr, size_t width)
+{
+    const struct coefs k = *c;
+    const int32_t off0 = k.off[0], off1 = k.off[1], off2 = k.off[2];
+
+    for (size_t i = 0; i < width; ++i)
+    {
+        int32_t r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+        luma[i] = clamp32((k.m[0][0] * r + k.m[0][1] * g + k.m[0][2] * b + off0) >> SHIFT8, 255);
+        cb[i] = clamp32((k.m[1][0] * r + k.m[1][1] * g + k.m[1][2] * b + off1) >> SHIFT8, 255);
+        cr[i] = clamp32((k.m[2][0] * r + k.m[2][1] * g + k.m[2][2] * b + off2) >> SHIFT8, 255);
+    }
+}
+
+static void forward_u16(const struct coefs *c, const uint16_t *rgb, uint16_t *luma,
+                        int32_t *cb, int32_t *cr, size_t width)
+{
+    const struct coefs k = *c;
+
+    for (size_t i = 0; i < width; ++i)
+    {
+        int64_t r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+        luma[i] = clamp64((k.m[0][0] * r + k.m[0][1] * g + k.m[0][2] * b + k.off[0]) >> SHIFT, 65535);
+        cb[i] = clamp64((k.m[1][0] * r + k.m[1][1] * g + k.m[1][2] * b + k.off[1]) >> SHIFT, 65535);
+        cr[i] = clamp64((k.m[2][0] * r + k.m[2][1] * g + k.m[2][2] * b + k.off[2]) >> SHIFT, 65535);
+    }
+}
+
+/*
+ * Average the chroma of each block of cols x rows samples in place, the
+ * first count entries of cb[0] and cr[0] hold the result
+ */
+static size_t average_chroma(int32_t *cb[2], int32_t *cr[2], size_t rows, size_t cstep, size_t width)
+{
+    size_t cx = 0;
+    for (size_t x = 0; x < width; x += cstep, ++cx)
+    {
+        size_t cols = x + cstep <= width ? cstep : 1;
+        int32_t n = cols * rows;
+        int32_t sb = n / 2, sr = n / 2;
+        for (size_t r = 0; r < rows; ++r)
+        {
+            for (size_t i = 0; i < cols; ++i)
+            {
+                sb += cb[r][x + i];
+                sr += cr[r][x + i];
+            }
+        }
+        cb[0][cx] = sb / n;
+        cr[0][cx] = sr / n;
+    }
+    return cx;
+}
+
+static int to_ycbcr_band(struct job *job)
+{
+    const simage_t *src = job->src_img;
+    const struct sil_planar *dst = job->dst_planes;
+    size_t width = sil_image_get_width(src);
+    size_t height = sil_image_get_height(src);
+    int wide = is_16bit(src);
+    size_t step = job->chroma == SIL_CHROMA_420 ? 2 : 1;
+    size_t cstep = job->chroma == SIL_CHROMA_444 ? 1 : 2;
+
+    // Cb and Cr for up to two rows, then the host order samples of a row
+    int32_t *buf = (int32_t *) malloc ((sizeof(int32_t) * 4 + sizeof(uint16_t) * 3) * width);
+    if (!buf)
+    {
+        return -1;
+    }
+    int32_t *cb[2] = {buf, buf + width};
+    int32_t *cr[2] = {buf + width * 2, buf + width * 3};
+    uint16_t *samples = (uint16_t *)(buf + width * 4);
+
+    for (size_t y = job->y0; y < job->y1; y += step)
+    {
+        size_t rows = y + step <= height ? step : 1;
+        for (size_t r = 0; r < rows; ++r)
+        {
+            if (wide)
+                forward_u16(&job->coefs, load_row16(src, y + r, samples, width * 3),
+                            (uint16_t *) plane_row(dst, 0, y + r), cb[r], cr[r], width);
+            else
+                forward_u8(&job->coefs, sil_image_data_row8(src, y + r),
+                           (uint8_t *) plane_row(dst, 0, y + r), cb[r], cr[r], width);
+        }
+
+        size_t count = average_chroma(cb, cr, rows, cstep, width);
+        if (wide)
+        {
+            uint16_t *pb = (uint16_t *) plane_row(dst, 1, y / step);
+            uint16_t *pr = (uint16_t *) plane_row(dst, 2, y / step);
+            for (size_t x = 0; x < count; ++x)
+            {
+                pb[x] = cb[0][x];
+                pr[x] = cr[0][x];
+            }
+        }
+        else
+        {
+            uint8_t *pb = (uint8_t *) plane_row(dst, 1, y / step);
+            uint8_t *pr = (uint8_t *) plane_row(dst, 2, y / step);
+            for (size_t x = 0; x < count; ++x)
+            {
+                pb[x] = cb[0][x];
+                pr[x] = cr[0][x];
+            }
+        }
+    }
+
+    free (buf);
+    return 0;
+}
+
+// Inverse matrix over planar rows with chroma at full width
+static void inverse_u8(const struct coefs *c, const uint8_t *luma, const uint8_t *cb,
+                       const uint8_t *cr, uint8_t *rgb, size_t width)
+{
+    const struct coefs k = *c;
+    const int32_t off0 = k.off[0], off1 = k.off[1], off2 = k.off[2];
+    const int32_t half = 1 << (SHIFT8 - 1);
+
+    for (size_t x = 0; x < width; ++x)
+    {
+        int32_t l = luma[x] - off0, b = cb[x] - off1, r = cr[x] - off2;
+        rgb[3 * x] = clamp32((k.m[0][0] * l + k.m[0][2] * r + half) >> SHIFT8, 255);
+        rgb[3 * x + 1] = clamp32((k.m[1][0] * l + k.m[1][1] * b + k.m[1][2] * r + half) >> SHIFT8, 255);
+        rgb[3 * x + 2] = clamp32((k.m[2][0] * l + k.m[2][1] * b + half) >> SHIFT8, 255);
+    }
+}
+
+static void inverse_u16(const struct coefs *c, const uint16_t *luma, const uint16_t *cb,
+                        const uint16_t *cr, uint16_t *rgb, size_t width)
+{
+    const struct coefs k = *c;
+    const int64_t half = 1 << (SHIFT - 1);
+
+    for (size_t x = 0; x < width; ++x)
+    {
+        int64_t l = luma[x] - k.off[0], b = cb[x] - k.off[1], r = cr[x] - k.off[2];
+        rgb[3 * x] = clamp64((k.m[0][0] * l + k.m[0][2] * r + half) >> SHIFT, 65535);
+        rgb[3 * x + 1] = clamp64((k.m[1][0] * l + k.m[1][1] * b + k.m[1][2] * r + half) >> SHIFT, 65535);
+        rgb[3 * x + 2] = clamp64((k.m[2][0] * l + k.m[2][1] * b + half) >> SHIFT, 65535);
+    }
+}
+
+static int from_ycbcr_band(struct job *job)
+{
+    const struct sil_planar *src = job->src_planes;
+    simage_t *dst = job->dst_img;
+    size_t width = sil_image_get_width(dst);
+    int wide = is_16bit(dst);
+    size_t step = job->chroma == SIL_CHROMA_420 ? 2 : 1;
+    int subsampled = job->chroma != SIL_CHROMA_444;
+
+    // Chroma upsampled to full width, then the RGB row
+    uint16_t *buf = (uint16_t *) malloc (sizeof(uint16_t) * 5 * width);
+    if (!buf)
+    {
+        return -1;
+    }
+    uint16_t *rgb = buf + width * 2;
+
+    for (size_t y = job->y0; y < job->y1; ++y)
+    {
+        if (wide)
+        {
+            const uint16_t *cb = (const uint16_t *) plane_row(src, 1, y / step);
+            const uint16_t *cr = (const uint16_t *) plane_row(src, 2, y / step);
+            if (subsampled)
+            {
+                for (size_t x = 0; x < width; ++x)
+                {
+                    buf[x] = cb[x / 2];
+                    buf[width + x] = cr[x / 2];
+                }
+                cb = buf;
+                cr = buf + width;
+            }
+            inverse_u16(&job->coefs, (const uint16_t *) plane_row(src, 0, y), cb, cr, rgb, width);
+            store_row16(dst, y, rgb, width * 3);
+        }
+        else
+        {
+            const uint8_t *cb = (const uint8_t *) plane_row(src, 1, y / step);
+            const uint8_t *cr = (const uint8_t *) plane_row(src, 2, y / step);
+            if (subsampled)
+            {
+                uint8_t *up = (uint8_t *) buf;
+                for (size_t x = 0; x < width; ++x)
+                {
+                    up[x] = cb[x / 2];
+                    up[width + x] = cr[x / 2];
+                }
+                cb = up;
+                cr = up + width;
+            }
+            inverse_u8(&job->coefs, (const uint8_t *) plane_row(src, 0, y), cb, cr,
+                       sil_image_data_row8(dst, y), width);
+        }
+    }
+
+    free (buf);
+    return 0;
+}
+
+struct bands
+{
+    struct job *proto;
+    size_t height;
+    size_t align;
+    int (*fn)(struct job *);
+};
+
+static void band_task(size_t begin, size_t end, void *arg)
+{
+    struct bands *bands = (struct bands *) arg;
+    struct job job = *bands->proto;
+
+    job.y0 = begin * bands->align;
+    job.y1 = end * bands->align < bands->height ? end * bands->align : bands->height;
+    if (bands->fn(&job) < 0)
+        __atomic_store_n(&bands->proto->failed, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Run fn over row bands on the thread pool. Band limits are multiples of
+ * align so chroma rows shared by two image rows stay in one band. Returns
+ * -1 if a band could not allocate its buffers.
+ */
+static int run_bands(struct job *proto, size_t height, size_t width, size_t align, int (*fn)(struct job *))
+{
+    struct bands bands = {proto, height, align, fn};
+    size_t units = (height + align - 1) / align;
+    proto->failed = 0;
+    sil_parallel_for(units, BAND_PIXELS / (width * align) + 1, band_task, &bands);
+    return proto->failed ? -1 : 0;
+}
+
+int sil_image_to_ycbcr(const simage_t *src, struct sil_planar *dst,
+                        smatrix_t matrix, srange_t range, schroma_t chroma)
+{
+    assert (sil_image_get_type(src) == SIL_IMAGE_RGB_24
+        || sil_image_get_type(src) == SIL_IMAGE_RGB_48);
+
+    struct job job;
+    memset(&job, 0, sizeof(job));
+    job.src_img = src;
+    job.dst_planes = dst;
+    job.chroma = chroma;
+    forward_coefs(matrix, range, is_16bit(src) ? 65535 : 255, &job.coefs);
+
+    return run_bands(&job, sil_image_get_height(src), sil_image_get_width(src),
+                     chroma == SIL_CHROMA_420 ? 2 : 1, to_ycbcr_band);
+}
+
+int sil_image_from_ycbcr(const struct sil_planar *src, simage_t *dst,
+                          smatrix_t matrix, srange_t range, schroma_t chroma)
+{
+    assert (sil_image_get_type(dst) == SIL_IMAGE_RGB_24
+        || sil_image_get_type(dst) == SIL_IMAGE_RGB_48);
+
+    struct job job;
+    memset(&job, 0, sizeof(job));
+    job.src_planes = src;
+    job.dst_img = dst;
+    job.chroma = chroma;
+    inverse_coefs(matrix, range, is_16bit(dst) ? 65535 : 255, &job.coefs);
+
+    return run_bands(&job, sil_image_get_height(dst), sil_image_get_width(dst), 1, from_ycbcr_band);
+}
+
+static int to_hsv_band(struct job *job)
+{
+    size_t width = sil_image_get_width(job->src_img);
+
+    simage_t *tmp = sil_image_new(width, 1, SIL_IMAGE_RGB_96F);
+    float *scratch = (float *) malloc (sizeof(float) * CONVERT_SCRATCH(width));
+    if (!tmp || !scratch)
+    {
+        if (tmp)
+            sil_image_free(tmp);
+        free (scratch);
+        return -1;
+    }
+    const float *rgb = sil_image_data_rowf(tmp, 0);
+
+    for (size_t y = job->y0; y < job->y1; ++y)
+    {
+        sil_image_convert_row_buf(job->src_img, y, tmp, 0, scratch);
+        float *hsv = sil_image_data_rowf(job->dst_img, y);
+
+        for (size_t x = 0; x < width; ++x)
+        {
+            float r = rgb[3 * x], g = rgb[3 * x + 1], b = rgb[3 * x + 2];
+            float max = fmaxf(r, fmaxf(g, b));
+            float min = fminf(r, fminf(g, b));
+            float delta = max - min;
+            float h = 0;
+
+            if (delta > 0)
+            {
+                if (max == r)
+                    h = (g - b) / delta;
+                else if (max == g)
+                    h = 2 + (b - r) / delta;
+                else
+                    h = 4 + (r - g) / delta;
+                h /= 6;
+                if (h < 0)
+                    h += 1;
+            }
+
+            hsv[3 * x] = h;
+            hsv[3 * x + 1] = max > 0 ? delta / max : 0;
+            hsv[3 * x + 2] = max;
+        }
+    }
+
+    sil_image_free(tmp);
+    free (scratch);
+    return 0;
+}
+
+static int from_hsv_band(struct job *job)
+{
+    size_t width = sil_image_get_width(job->src_img);
+
+    simage_t *tmp = sil_image_new(width, 1, SIL_IMAGE_RGB_96F);
+    float *scratch = (float *) malloc (sizeof(float) * CONVERT_SCRATCH(width));
+    if (!tmp || !scratch)
+    {
+        if (tmp)
+            sil_image_free(tmp);
+        free (scratch);
+        return -1;
+    }
+    float *rgb = sil_image_data_rowf(tmp, 0);
+
+    for (size_t y = job->y0; y < job->y1; ++y)
+    {
+        const float *hsv = sil_image_data_rowf(job->src_img, y);
+
+        for (size_t x = 0; x < width; ++x)
+        {
+            float h = hsv[3 * x] * 6, s = hsv[3 * x + 1], v = hsv[3 * x + 2];
+            int sector = (int) h % 6;
+            float f = h - floorf(h);
+            float p = v * (1 - s);
+            float q = v * (1 - s * f);
+            float t = v * (1 - s * (1 - f));
+            float out[6][3] = {{v, t, p}, {q, v, p}, {p, v, t},
+                               {p, q, v}, {t, p, v}, {v, p, q}};
+
+            rgb[3 * x] = out[sector][0];
+            rgb[3 * x + 1] = out[sector][1];
+            rgb[3 * x + 2] = out[sector][2];
+        }
+
+        sil_image_convert_row_buf(tmp, 0, job->dst_img, y, scratch);
+    }
+
+    sil_image_free(tmp);
+    free (scratch);
+    return 0;
+}
+
+simage_t *sil_image_rgb_to_hsv(const simage_t *src)
+{
+    size_t width = sil_image_get_width(src);
+    size_t height = sil_image_get_height(src);
+
+    simage_t *dst = sil_image_new(width, height, SIL_IMAGE_RGB_96F);
+    if (!dst)
+        return NULL;
+
+    struct job job;
+    memset(&job, 0, sizeof(job));
+    job.src_img = src;
+    job.dst_img = dst;
+    if (run_bands(&job, height, width, 1, to_hsv_band) < 0)
+    {
+        sil_image_free(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+simage_t *sil_image_hsv_to_rgb(const simage_t *src, stype_t type)
+{
+    assert (sil_image_get_type(src) == SIL_IMAGE_RGB_96F);
+
+    size_t width = sil_image_get_width(src);
+    size_t height = sil_image_get_height(src);
+
+    simage_t *dst = sil_image_new(width, height, type);
+    if (!dst)
+        return NULL;
+
+    struct job job;
+    memset(&job, 0, sizeof(job));
+    job.src_img = src;
+    job.dst_img = dst;
+    if (run_bands(&job, height, width, 1, from_hsv_band) < 0)
+    {
+        sil_image_free(dst);
+        return NULL;
+    }
+    return dst;
+}
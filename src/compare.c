@@ -0,0 +1,414 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sil/compare.h>
+#include <sil/parallel.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <pthread.h>
+
+enum sample
+{
+    SAMPLE_U8,
+    SAMPLE_U16,
+    SAMPLE_F32
+};
+
+struct stats
+{
+    double sum;
+    double max;
+    size_t x;
+    size_t y;
+};
+
+struct job
+{
+    const simage_t *a;
+    const simage_t *b;
+    pthread_mutex_t lock;
+    struct stats total;
+    int failed;
+};
+
+static enum sample sample_type(stype_t type)
+{
+    switch (type)
+    {
+        case SIL_IMAGE_GRAY_16:
+        case SIL_IMAGE_RGB_48:
+            return SAMPLE_U16;
+        case SIL_IMAGE_GRAY_32F:
+        case SIL_IMAGE_RGB_96F:
+            return SAMPLE_F32;
+        default:
+            return SAMPLE_U8;
+    }
+}
+
+static void check_images(const simage_t *a, const simage_t *b)
+{
+    assert (sil_image_get_type(a) != SIL_IMAGE_BINARY);
+    assert (sil_image_get_type(a) == sil_image_get_type(b)
+        && sil_image_get_width(a) == sil_image_get_width(b)
+        && sil_image_get_height(a) == sil_image_get_height(b));
+}
+
+/*
+ * Row kernels: the sum and maximum are plain reductions the compiler can
+ * vectorize, the position of the maximum is only searched when the row
+ * beats the current one.
+ */
+static void stats_u8(const uint8_t *a, const uint8_t *b, size_t count, size_t y, size_t channels, struct stats *s)
+{
+    uint64_t sum = 0;
+    unsigned max = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        sum += d * d;
+        max = d > max ? d : max;
+    }
+
+    s->sum += sum;
+    if (max > s->max)
+    {
+        size_t i = 0;
+        while ((unsigned) abs(a[i] - b[i]) != max)
+            ++i;
+        s->max = max;
+        s->x = i / channels;
+        s->y = y;
+    }
+}
+
+static void stats_u16(const uint16_t *a, const uint16_t *b, size_t count, size_t y, size_t channels, struct stats *s)
+{
+    uint64_t sum = 0;
+    uint32_t max = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        sum += (uint64_t) d * d;
+        max = d > max ? d : max;
+    }
+
+    s->sum += sum;
+    if (max > s->max)
+    {
+        size_t i = 0;
+        while ((uint32_t) abs(a[i] - b[i]) != max)
+            ++i;
+        s->max = max;
+        s->x = i / channels;
+        s->y = y;
+    }
+}
+
+/*
+ * Floating point sums cannot be reordered into vectors, so the float
+ * kernel keeps LANES independent partial sums and maxima instead
+ */
+#define LANES 8
+
+static void stats_f32(const float *a, const float *b, size_t count, size_t y, size_t channels, struct stats *s)
+{
+    double sums[LANES] = {0};
+    float maxs[LANES] = {0};
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES)
+    {
+        for (size_t k = 0; k < LANES; ++k)
+        {
+            float d = fabsf(a[i + k] - b[i + k]);
+            sums[k] += d * d;
+            maxs[k] = d > maxs[k] ? d : maxs[k];
+        }
+    }
+
+    double sum = 0;
+    float max = 0;
+    for (; i < count; ++i)
+    {
+        float d = fabsf(a[i] - b[i]);
+        sum += d * d;
+        max = d > max ? d : max;
+    }
+    for (size_t k = 0; k < LANES; ++k)
+    {
+        sum += sums[k];
+        max = maxs[k] > max ? maxs[k] : max;
+    }
+
+    s->sum += sum;
+    if (max > s->max)
+    {
+        size_t i = 0;
+        while (fabsf(a[i] - b[i]) != max)
+            ++i;
+        s->max = max;
+        s->x = i / channels;
+        s->y = y;
+    }
+}
+
+// Accumulate the error of a band of rows into the job total
+static void band_stats(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    const simage_t *a = job->a;
+    const simage_t *b = job->b;
+    size_t channels = sil_image_get_channels(a);
+    size_t count = sil_image_get_width(a) * channels;
+    struct stats stats = {0, 0, 0, 0};
+
+    uint16_t *buf = NULL;
+    enum sample sample = sample_type(sil_image_get_type(a));
+    if (sample == SAMPLE_U16)
+    {
+        buf = (uint16_t *) malloc (sizeof(uint16_t) * count * 2);
+        if (!buf)
+        {
+            job->failed = 1;
+            return;
+        }
+    }
+
+    for (size_t y = begin; y < end; ++y)
+    {
+        switch (sample)
+        {
+            case SAMPLE_U8:
+                stats_u8(sil_image_data_row8(a, y), sil_image_data_row8(b, y),
+                         count, y, channels, &stats);
+                break;
+            case SAMPLE_U16:
+                stats_u16(load_row16(a, y, buf, count), load_row16(b, y, buf + count, count),
+                          count, y, channels, &stats);
+                break;
+            case SAMPLE_F32:
+                stats_f32(sil_image_data_rowf(a, y), sil_image_data_rowf(b, y),
+                          count, y, channels, &stats);
+                break;
+        }
+    }
+    free (buf);
+
+    // Bands finish in any order, the first maximum in the image wins
+    pthread_mutex_lock(&job->lock);
+    job->total.sum += stats.sum;
+    if (stats.max > job->total.max
+        || (stats.max > 0 && stats.max == job->total.max
+            && (stats.y < job->total.y || (stats.y == job->total.y && stats.x < job->total.x))))
+    {
+        job->total.max = stats.max;
+        job->total.x = stats.x;
+        job->total.y = stats.y;
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Reduce the error of the images over row bands run on the thread pool
+static struct stats compute_stats(const simage_t *a, const simage_t *b)
+{
+    check_images(a, b);
+
+    size_t bytes = sil_image_get_width(a) * sil_image_byte_per_pixel(a);
+
+    struct job job;
+    job.a = a;
+    job.b = b;
+    job.failed = 0;
+    memset(&job.total, 0, sizeof(job.total));
+    pthread_mutex_init(&job.lock, NULL);
+
+    sil_parallel_for(sil_image_get_height(a), BAND_BYTES / bytes + 1, band_stats, &job);
+
+    pthread_mutex_destroy(&job.lock);
+    if (job.failed)
+        job.total.sum = job.total.max = NAN;
+    return job.total;
+}
+
+/*
+ * 16-bit images of different byte order. The big-endian samples are
+ * swapped in chunks on the stack and compared with the native ones, up to
+ * the first difference.
+ */
+static int equal_swapped(const simage_t *a, const simage_t *b)
+{
+    enum { CHUNK = 1024 };
+    uint16_t buf[CHUNK];
+
+    if (sil_image_get_order(a) == SIL_IMAGE_ORDER_NATIVE)
+    {
+        const simage_t *t = a;
+        a = b;
+        b = t;
+    }
+
+    size_t count = sil_image_get_width(a) * sil_image_get_channels(a);
+    for (size_t y = 0; y < sil_image_get_height(a); ++y)
+    {
+        const uint8_t *big = sil_image_data_row8(a, y);
+        const uint16_t *native = sil_image_data_row16(b, y);
+        for (size_t i = 0; i < count; i += CHUNK)
+        {
+            size_t n = count - i < CHUNK ? count - i : CHUNK;
+            swap16((uint8_t *) buf, big + 2 * i, n);
+            if (memcmp(buf, native + i, n * sizeof(uint16_t)) != 0)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+int sil_image_equal(const simage_t *a, const simage_t *b)
+{
+    if (sil_image_get_type(a) != sil_image_get_type(b)
+        || sil_image_get_width(a) != sil_image_get_width(b)
+        || sil_image_get_height(a) != sil_image_get_height(b))
+        return 0;
+
+    if (sample_type(sil_image_get_type(a)) == SAMPLE_U16
+        && sil_image_get_order(a) != sil_image_get_order(b))
+        return equal_swapped(a, b);
+
+    // Stops at the first row with a difference
+    size_t bytes = sil_image_get_row_bytes(a);
+    size_t width = sil_image_get_width(a);
+    uint8_t mask = 0xff;
+
+    // Bits past the width of binary rows are not part of the image
+    if (sil_image_get_type(a) == SIL_IMAGE_BINARY && width % 8)
+    {
+        mask = 0xff00 >> (width % 8);
+        --bytes;
+    }
+
+    for (size_t y = 0; y < sil_image_get_height(a); ++y)
+    {
+        const uint8_t *pa = sil_image_data_row8(a, y);
+        const uint8_t *pb = sil_image_data_row8(b, y);
+        if (memcmp(pa, pb, bytes) != 0
+            || (mask != 0xff && ((pa[bytes] ^ pb[bytes]) & mask)))
+            return 0;
+    }
+    return 1;
+}
+
+simage_t *sil_image_absdiff(const simage_t *a, const simage_t *b)
+{
+    check_images(a, b);
+
+    size_t width = sil_image_get_width(a);
+    size_t height = sil_image_get_height(a);
+    size_t count = width * sil_image_get_channels(a);
+
+    simage_t *dst = sil_image_new(width, height, sil_image_get_type(a));
+    if (!dst)
+        return NULL;
+    sil_image_tag_order(dst, sil_image_get_order(a));
+
+    uint16_t *buf = (uint16_t *) malloc (sizeof(uint16_t) * count * 3);
+    if (!buf)
+    {
+        sil_image_free(dst);
+        return NULL;
+    }
+
+    for (size_t y = 0; y < height; ++y)
+    {
+        switch (sample_type(sil_image_get_type(a)))
+        {
+            case SAMPLE_U8:
+            {
+                const uint8_t *pa = sil_image_data_row8(a, y);
+                const uint8_t *pb = sil_image_data_row8(b, y);
+                uint8_t *pd = sil_image_data_row8(dst, y);
+                for (size_t i = 0; i < count; ++i)
+                    pd[i] = pa[i] > pb[i] ? pa[i] - pb[i] : pb[i] - pa[i];
+                break;
+            }
+            case SAMPLE_U16:
+            {
+                const uint16_t *pa = load_row16(a, y, buf, count);
+                const uint16_t *pb = load_row16(b, y, buf + count, count);
+                uint16_t *pd = buf + 2 * count;
+                for (size_t i = 0; i < count; ++i)
+                    pd[i] = pa[i] > pb[i] ? pa[i] - pb[i] : pb[i] - pa[i];
+                store_row16(dst, y, pd, count);
+                break;
+            }
+            case SAMPLE_F32:
+            {
+                const float *pa = sil_image_data_rowf(a, y);
+                const float *pb = sil_image_data_rowf(b, y);
+                float *pd = sil_image_data_rowf(dst, y);
+                for (size_t i = 0; i < count; ++i)
+                    pd[i] = fabsf(pa[i] - pb[i]);
+                break;
+            }
+        }
+    }
+
+    free (buf);
+    return dst;
+}
+
+double sil_image_mse(const simage_t *a, const simage_t *b)
+{
+    size_t count = sil_image_get_width(a) * sil_image_get_height(a) * sil_image_get_channels(a);
+    return compute_stats(a, b).sum / count;
+}
+
+double sil_image_psnr(const simage_t *a, const simage_t *b)
+{
+    double peak = 1.0;
+    switch (sample_type(sil_image_get_type(a)))
+    {
+        case SAMPLE_U8:
+            peak = 255.0;
+            break;
+        case SAMPLE_U16:
+            peak = 65535.0;
+            break;
+        case SAMPLE_F32:
+            peak = 1.0;
+            break;
+    }
+
+    double mse = sil_image_mse(a, b);
+    if (mse == 0)
+        return INFINITY;
+    return 10.0 * log10(peak * peak / mse);
+}
+
+double sil_image_max_error(const simage_t *a, const simage_t *b, size_t *x, size_t *y)
+{
+    struct stats stats = compute_stats(a, b);
+    if (x)
+        *x = stats.x;
+    if (y)
+        *y = stats.y;
+    return stats.max;
+}
@@ -0,0 +1,296 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sil/hash.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#define PRIME1 0x9e3779b185ebca87ULL
+#define PRIME2 0xc2b2ae3d27d4eb4fULL
+#define PRIME3 0x165667b19e3779f9ULL
+#define PRIME4 0x85ebca77c2b2ae63ULL
+#define PRIME5 0x27d4eb2f165667c5ULL
+
+// Side of the grids used by the perceptual hashes
+#define DHASH_SIZE 8
+#define PHASH_SIZE 32
+#define PHASH_LOW 8
+
+static inline uint64_t rotl(uint64_t v, int r)
+{
+    return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t v)
+{
+    acc += v * PRIME2;
+    return rotl(acc, 31) * PRIME1;
+}
+
+static inline uint64_t avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+/*
+ * Digest of one row. Four independent lanes consume 32 byte stripes so the
+ * multiplications overlap, the tail is folded in afterwards.
+ */
+static uint64_t hash_row(const uint8_t *p, size_t len, uint64_t seed)
+{
+    uint64_t v1 = seed + PRIME1 + PRIME2;
+    uint64_t v2 = seed + PRIME2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME1;
+
+    size_t stripes = len / 32;
+    for (size_t i = 0; i < stripes; ++i, p += 32)
+    {
+        v1 = round64(v1, read64(p));
+        v2 = round64(v2, read64(p + 8));
+        v3 = round64(v3, read64(p + 16));
+        v4 = round64(v4, read64(p + 24));
+    }
+
+    uint64_t h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h += len;
+
+    len %= 32;
+    for (; len >= 8; len -= 8, p += 8)
+        h = rotl(h ^ round64(0, read64(p)), 27) * PRIME1 + PRIME4;
+    for (; len > 0; --len, ++p)
+        h = rotl(h ^ (*p * PRIME5), 11) * PRIME1;
+
+    return avalanche(h);
+}
+
+void sil_image_hash128(const simage_t *img, uint64_t *hash)
+{
+    size_t width = sil_image_get_width(img);
+    size_t height = sil_image_get_height(img);
+    size_t bytes = sil_image_get_row_bytes(img);
+    stype_t type = sil_image_get_type(img);
+
+    /*
+     * Native 16-bit rows are hashed in their big-endian PNM layout and
+     * binary rows with the bits past the width cleared
+     */
+    int swap = (type == SIL_IMAGE_GRAY_16 || type == SIL_IMAGE_RGB_48)
+               && sil_image_get_order(img) == SIL_IMAGE_ORDER_NATIVE;
+    int mask = type == SIL_IMAGE_BINARY && width % 8;
+
+    simage_t *row = NULL;
+    if (swap)
+        row = sil_image_new(width, 1, type);
+    else if (mask)
+        row = sil_image_zero_new(width, 1, type);
+
+    // Hashing the raw rows would give a different digest for the same pixels
+    if ((swap || mask) && !row)
+    {
+        hash[0] = hash[1] = 0;
+        errno = ENOMEM;
+        return;
+    }
+
+    uint64_t h1 = PRIME5 ^ (type * PRIME1);
+    uint64_t h2 = avalanche(width * PRIME2 + height * PRIME3);
+
+    for (size_t i = 0; i < height; ++i)
+    {
+        const uint8_t *p;
+        if (row)
+        {
+            sil_image_convert_row(img, i, row, 0);
+            p = sil_image_data_row8(row, 0);
+        }
+        else
+            p = sil_image_data_row8(img, i);
+
+        uint64_t d = hash_row(p, bytes, i);
+        h1 = rotl(h1 ^ d, 29) * PRIME1 + PRIME4;
+        h2 = rotl(h2 + d * PRIME3, 31) * PRIME2;
+    }
+
+    if (row)
+        sil_image_free(row);
+
+    hash[0] = avalanche(h1 + h2);
+    hash[1] = avalanche(h2 ^ rotl(h1, 17));
+}
+
+uint64_t sil_image_hash(const simage_t *img)
+{
+    uint64_t hash[2];
+    sil_image_hash128(img, hash);
+    return hash[0];
+}
+
+/*
+ * Area average of the luma over a gw x gh grid. Grid cells that get no
+ * pixel (images smaller than the grid) take the nearest pixel. Returns 0
+ * with errno set to ENOMEM if the row buffers cannot be allocated.
+ */
+static int downscale(const simage_t *img, size_t gw, size_t gh, float *grid)
+{
+    size_t width = sil_image_get_width(img);
+    size_t height = sil_image_get_height(img);
+
+    simage_t *row = sil_image_new(width, 1, SIL_IMAGE_GRAY_32F);
+    size_t *count = (size_t *) calloc(gw * gh, sizeof(size_t));
+    float *scratch = (float *) malloc (sizeof(float) * CONVERT_SCRATCH(width));
+    if (!row || !count || !scratch)
+    {
+        if (row)
+            sil_image_free(row);
+        free (count);
+        free (scratch);
+        errno = ENOMEM;
+        return 0;
+    }
+
+    const float *luma = sil_image_data_rowf(row, 0);
+    memset(grid, 0, sizeof(float) * gw * gh);
+
+    for (size_t y = 0; y < height; ++y)
+    {
+        sil_image_convert_row_buf(img, y, row, 0, scratch);
+        float *cells = grid + y * gh / height * gw;
+        size_t *counts = count + y * gh / height * gw;
+        for (size_t x = 0; x < width; ++x)
+        {
+            cells[x * gw / width] += luma[x];
+            ++counts[x * gw / width];
+        }
+    }
+
+    for (size_t i = 0; i < gh; ++i)
+    {
+        for (size_t j = 0; j < gw; ++j)
+        {
+            if (count[i * gw + j])
+                grid[i * gw + j] /= count[i * gw + j];
+            else
+            {
+                sil_image_convert_row_buf(img, i * height / gh, row, 0, scratch);
+                grid[i * gw + j] = luma[j * width / gw];
+            }
+        }
+    }
+
+    sil_image_free(row);
+    free (count);
+    free (scratch);
+    return 1;
+}
+
+// Each bit tells whether the luma grows between neighbour cells of a row
+uint64_t sil_image_dhash(const simage_t *img)
+{
+    float grid[(DHASH_SIZE + 1) * DHASH_SIZE];
+    if (!downscale(img, DHASH_SIZE + 1, DHASH_SIZE, grid))
+        return 0;
+
+    uint64_t hash = 0;
+    for (size_t i = 0; i < DHASH_SIZE; ++i)
+    {
+        const float *cells = grid + i * (DHASH_SIZE + 1);
+        for (size_t j = 0; j < DHASH_SIZE; ++j)
+            hash = (hash << 1) | (cells[j] < cells[j + 1]);
+    }
+    return hash;
+}
+
+static int compare_floats(const void *a, const void *b)
+{
+    float fa = *(const float *) a;
+    float fb = *(const float *) b;
+    return (fa > fb) - (fa < fb);
+}
+
+/*
+ * The lowest 8x8 DCT coefficients of a 32x32 luma grid, each bit set when
+ * the coefficient is above the median. The DC term is left out of the median.
+ */
+uint64_t sil_image_phash(const simage_t *img)
+{
+    float grid[PHASH_SIZE * PHASH_SIZE];
+    if (!downscale(img, PHASH_SIZE, PHASH_SIZE, grid))
+        return 0;
+
+    float basis[PHASH_LOW][PHASH_SIZE];
+    for (size_t k = 0; k < PHASH_LOW; ++k)
+        for (size_t n = 0; n < PHASH_SIZE; ++n)
+            basis[k][n] = cosf((float) M_PI / PHASH_SIZE * (n + 0.5f) * k);
+
+    // Separable DCT: rows first, then columns of the low frequencies only
+    float rows[PHASH_SIZE][PHASH_LOW];
+    for (size_t i = 0; i < PHASH_SIZE; ++i)
+    {
+        for (size_t k = 0; k < PHASH_LOW; ++k)
+        {
+            float sum = 0;
+            for (size_t n = 0; n < PHASH_SIZE; ++n)
+                sum += grid[i * PHASH_SIZE + n] * basis[k][n];
+            rows[i][k] = sum;
+        }
+    }
+
+    float dct[PHASH_LOW * PHASH_LOW];
+    for (size_t k = 0; k < PHASH_LOW; ++k)
+    {
+        for (size_t j = 0; j < PHASH_LOW; ++j)
+        {
+            float sum = 0;
+            for (size_t n = 0; n < PHASH_SIZE; ++n)
+                sum += rows[n][j] * basis[k][n];
+            dct[k * PHASH_LOW + j] = sum;
+        }
+    }
+
+    float sorted[PHASH_LOW * PHASH_LOW - 1];
+    memcpy(sorted, dct + 1, sizeof(sorted));
+    qsort(sorted, PHASH_LOW * PHASH_LOW - 1, sizeof(float), compare_floats);
+    float median = sorted[(PHASH_LOW * PHASH_LOW - 1) / 2];
+
+    uint64_t hash = 0;
+    for (size_t i = 0; i < PHASH_LOW * PHASH_LOW; ++i)
+        hash = (hash << 1) | (dct[i] > median);
+    return hash;
+}
+
+int sil_hash_distance(uint64_t a, uint64_t b)
+{
+    return __builtin_popcountll(a ^ b);
+}
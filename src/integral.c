@@ -0,0 +1,251 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sil/integral.h>
+#include <sil/parallel.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Work of each task of the row and column passes
+#define BAND_ENTRIES (1 << 16)
+#define STRIP_ENTRIES 64
+
+/*
+ * Tables have one more row and column than the image, the first ones are
+ * zero. Channels are interleaved like in the image. Rows are padded to a
+ * whole number of cache lines so the strips of the column pass never share
+ * one.
+ */
+struct sintegral
+{
+    size_t width;
+    size_t height;
+    size_t channels;
+    // Entries per table row
+    size_t pitch;
+    int wide;
+    void *sum;
+    uint64_t *sqsum;
+};
+
+struct job
+{
+    const simage_t *img;
+    sintegral_t *table;
+    int failed;
+};
+
+static void load_row(const simage_t *img, size_t y, uint32_t *out, uint16_t *buf, size_t count)
+{
+    stype_t type = sil_image_get_type(img);
+
+    if (type == SIL_IMAGE_GRAY_8 || type == SIL_IMAGE_RGB_24)
+    {
+        const uint8_t *row = sil_image_data_row8(img, y);
+        for (size_t i = 0; i < count; ++i)
+            out[i] = row[i];
+    }
+    else
+    {
+        const uint16_t *row = load_row16(img, y, buf, count);
+        for (size_t i = 0; i < count; ++i)
+            out[i] = row[i];
+    }
+}
+
+// Horizontal prefix sums of independent rows
+static void row_pass(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    sintegral_t *t = job->table;
+    size_t ch = t->channels;
+    size_t count = t->width * ch;
+
+    uint32_t *samples = (uint32_t *) malloc ((sizeof(uint32_t) + sizeof(uint16_t)) * count);
+    if (!samples)
+    {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (size_t y = begin; y < end; ++y)
+    {
+        load_row(job->img, y, samples, (uint16_t *)(samples + count), count);
+        size_t base = (y + 1) * t->pitch;
+
+        if (t->wide)
+        {
+            uint64_t *row = (uint64_t *) t->sum + base;
+            for (size_t i = 0; i < count; ++i)
+                row[i + ch] = row[i] + samples[i];
+        }
+        else
+        {
+            uint32_t *row = (uint32_t *) t->sum + base;
+            for (size_t i = 0; i < count; ++i)
+                row[i + ch] = row[i] + samples[i];
+        }
+
+        if (t->sqsum)
+        {
+            uint64_t *row = t->sqsum + base;
+            for (size_t i = 0; i < count; ++i)
+                row[i + ch] = row[i] + (uint64_t) samples[i] * samples[i];
+        }
+    }
+
+    free (samples);
+}
+
+/*
+ * Vertical accumulation over strips of columns. Each row of a strip is
+ * added to the one below, a flat loop the compiler vectorizes.
+ */
+static void column_pass(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    sintegral_t *t = job->table;
+
+    for (size_t y = 2; y <= t->height; ++y)
+    {
+        size_t base = y * t->pitch;
+
+        if (t->wide)
+        {
+            uint64_t *row = (uint64_t *) t->sum + base;
+            const uint64_t *up = row - t->pitch;
+            for (size_t i = begin; i < end; ++i)
+                row[i] += up[i];
+        }
+        else
+        {
+            uint32_t *row = (uint32_t *) t->sum + base;
+            const uint32_t *up = row - t->pitch;
+            for (size_t i = begin; i < end; ++i)
+                row[i] += up[i];
+        }
+
+        if (t->sqsum)
+        {
+            uint64_t *row = t->sqsum + base;
+            const uint64_t *up = row - t->pitch;
+            for (size_t i = begin; i < end; ++i)
+                row[i] += up[i];
+        }
+    }
+}
+
+// Zeroed table aligned to a cache line, like the rows of the pitch
+static void *new_table(size_t entries, size_t size)
+{
+    void *table;
+    if (posix_memalign(&table, CACHE_LINE, entries * size) != 0)
+        return NULL;
+    return memset(table, 0, entries * size);
+}
+
+sintegral_t *sil_image_integral(const simage_t *img, int squares)
+{
+    stype_t type = sil_image_get_type(img);
+    assert (type == SIL_IMAGE_GRAY_8 || type == SIL_IMAGE_GRAY_16
+        || type == SIL_IMAGE_RGB_24 || type == SIL_IMAGE_RGB_48);
+
+    sintegral_t *t = (sintegral_t *) malloc (sizeof(sintegral_t));
+    if (!t)
+        return NULL;
+
+    t->width = sil_image_get_width(img);
+    t->height = sil_image_get_height(img);
+    t->channels = sil_image_get_channels(img);
+
+    uint64_t maxval = type == SIL_IMAGE_GRAY_8 || type == SIL_IMAGE_RGB_24 ? 255 : 65535;
+    t->wide = maxval * t->width * t->height > UINT32_MAX;
+
+    size_t line = CACHE_LINE / (t->wide ? sizeof(uint64_t) : sizeof(uint32_t));
+    t->pitch = ((t->width + 1) * t->channels + line - 1) / line * line;
+
+    size_t entries = t->pitch * (t->height + 1);
+    t->sum = new_table(entries, t->wide ? sizeof(uint64_t) : sizeof(uint32_t));
+    t->sqsum = squares ? (uint64_t *) new_table(entries, sizeof(uint64_t)) : NULL;
+    if (!t->sum || (squares && !t->sqsum))
+    {
+        sil_integral_free(t);
+        return NULL;
+    }
+
+    struct job job = {img, t, 0};
+    sil_parallel_for(t->height, BAND_ENTRIES / t->pitch + 1, row_pass, &job);
+    if (job.failed)
+    {
+        sil_integral_free(t);
+        return NULL;
+    }
+    sil_parallel_for(t->pitch, STRIP_ENTRIES, column_pass, &job);
+
+    return t;
+}
+
+void sil_integral_free(sintegral_t *table)
+{
+    free (table->sum);
+    free (table->sqsum);
+    free (table);
+}
+
+const void *sil_integral_row(const sintegral_t *table, size_t y, int *wide)
+{
+    assert (y <= table->height);
+
+    *wide = table->wide;
+    if (table->wide)
+        return (const uint64_t *) table->sum + y * table->pitch;
+    return (const uint32_t *) table->sum + y * table->pitch;
+}
+
+static inline uint64_t entry(const sintegral_t *t, const void *table, int wide, size_t channel, size_t x, size_t y)
+{
+    size_t i = y * t->pitch + x * t->channels + channel;
+    return wide ? ((const uint64_t *) table)[i] : ((const uint32_t *) table)[i];
+}
+
+static uint64_t rect(const sintegral_t *t, const void *table, int wide, size_t channel,
+                     size_t x, size_t y, size_t width, size_t height)
+{
+    assert (channel < t->channels && x + width <= t->width && y + height <= t->height);
+
+    return entry(t, table, wide, channel, x + width, y + height)
+         - entry(t, table, wide, channel, x, y + height)
+         - entry(t, table, wide, channel, x + width, y)
+         + entry(t, table, wide, channel, x, y);
+}
+
+uint64_t sil_integral_sum(const sintegral_t *table, size_t channel,
+                          size_t x, size_t y, size_t width, size_t height)
+{
+    return rect(table, table->sum, table->wide, channel, x, y, width, height);
+}
+
+uint64_t sil_integral_sqsum(const sintegral_t *table, size_t channel,
+                            size_t x, size_t y, size_t width, size_t height)
+{
+    assert (table->sqsum);
+    return rect(table, table->sqsum, 1, channel, x, y, width, height);
+}
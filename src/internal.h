@@ -0,0 +1,120 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Helpers shared by the modules of the library, not installed with the
+ * public headers
+ */
+
+#ifndef SIL_INTERNAL_H
+#define SIL_INTERNAL_H
+
+#include <sil/simage.h>
+#include <sil/integral.h>
+
+#include <string.h>
+
+#define CACHE_LINE 64
+
+// Default work of a row band run on the thread pool
+#define BAND_BYTES (1 << 16)
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_BIG_ENDIAN
+#endif
+
+/*
+ * Swap the bytes of count 16-bit samples, in place when dst == src. Four
+ * samples are swapped at a time within a 64-bit word, rows are word
+ * aligned so only the tail is scalar. Big-endian hosts only copy.
+ */
+static inline void swap16(uint8_t *dst, const uint8_t *src, size_t count)
+{
+#ifndef HOST_BIG_ENDIAN
+    size_t words = count / 4;
+    for (size_t i = 0; i < words; ++i)
+    {
+        uint64_t w;
+        memcpy(&w, src + 8 * i, sizeof(w));
+        w = ((w & 0x00ff00ff00ff00ffULL) << 8) | ((w >> 8) & 0x00ff00ff00ff00ffULL);
+        memcpy(dst + 8 * i, &w, sizeof(w));
+    }
+
+    for (size_t i = words * 4; i < count; ++i)
+    {
+        uint8_t hi = src[2 * i];
+        dst[2 * i] = src[2 * i + 1];
+        dst[2 * i + 1] = hi;
+    }
+#else
+    if (dst != src)
+        memmove(dst, src, count * 2);
+#endif
+}
+
+// 16-bit samples of a row in host order, swapped into buf when needed
+static inline const uint16_t *load_row16(const simage_t *img, size_t y, uint16_t *buf, size_t count)
+{
+    if (sil_image_get_order(img) == SIL_IMAGE_ORDER_NATIVE)
+        return sil_image_data_row16(img, y);
+
+    swap16((uint8_t *) buf, sil_image_data_row8(img, y), count);
+    return buf;
+}
+
+static inline void store_row16(simage_t *img, size_t y, const uint16_t *buf, size_t count)
+{
+    if (sil_image_get_order(img) == SIL_IMAGE_ORDER_NATIVE)
+        memcpy(sil_image_data_row16(img, y), buf, count * sizeof(uint16_t));
+    else
+        swap16(sil_image_data_row8(img, y), (const uint8_t *) buf, count);
+}
+
+/*
+ * Set the byte order of an image without swapping its samples, for new
+ * images whose rows are written in that order right after
+ */
+void sil_image_tag_order(simage_t *img, sorder_t order);
+
+// Floats of scratch sil_image_convert_row_buf needs for a row of width pixels
+#define CONVERT_SCRATCH(width) ((width) * 8)
+
+/*
+ * sil_image_convert_row with a caller owned scratch buffer, for callers
+ * converting many rows
+ */
+void sil_image_convert_row_buf(const simage_t *src, size_t src_y,
+                               simage_t *dst, size_t dst_y, float *buf);
+
+/*
+ * Row y of the sum table, y from 0 to the image height, for kernels that
+ * read the table directly. Entries are uint64_t when wide is set, uint32_t
+ * otherwise, the one of pixel x and channel c is x * channels + c.
+ */
+const void *sil_integral_row(const sintegral_t *table, size_t y, int *wide);
+
+/*
+ * Bits of the last byte of a binary row that belong to the image. The rest
+ * may hold pixels of a parent image when the row comes from a ROI.
+ */
+static inline uint8_t tail_mask(size_t width)
+{
+    return width % 8 ? (uint8_t)(0xff00 >> (width % 8)) : 0xff;
+}
+
+#endif
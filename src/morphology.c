@@ -0,0 +1,306 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sil/morphology.h>
+#include <sil/parallel.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Rows per task, vertical bands also span at least two element heights
+#define BAND_ROWS 64
+
+struct job
+{
+    const simage_t *src;
+    simage_t *dst;
+    // Element size and anchor
+    size_t width;
+    size_t height;
+    size_t ax;
+    size_t ay;
+    const uint8_t *mask;
+    int dilate;
+    int failed;
+};
+
+static inline uint8_t op(uint8_t a, uint8_t b, int dilate)
+{
+    if (dilate)
+        return a > b ? a : b;
+    return a < b ? a : b;
+}
+
+// Kept as two flat loops so each one vectorizes to a single min or max
+static void combine(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t n, int dilate)
+{
+    if (dilate)
+        for (size_t i = 0; i < n; ++i)
+            dst[i] = a[i] > b[i] ? a[i] : b[i];
+    else
+        for (size_t i = 0; i < n; ++i)
+            dst[i] = a[i] < b[i] ? a[i] : b[i];
+}
+
+static inline uint8_t border(int dilate)
+{
+    return dilate ? 0 : 255;
+}
+
+/*
+ * van Herk/Gil-Werman: the padded row is split in blocks of the element
+ * size, with running results from the start (g) and from the end (h) of
+ * each block. Every window spans the tail of one block and the head of the
+ * next, so each output is op(h[x], g[x + w - 1]).
+ */
+static void horizontal_pass(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    size_t n = sil_image_get_width(job->src);
+    size_t w = job->width;
+    int dilate = job->dilate;
+    size_t len = (n + w - 1 + w - 1) / w * w;
+
+    uint8_t *buffer = (uint8_t *) malloc (3 * len);
+    if (!buffer)
+    {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    uint8_t *ext = buffer, *g = buffer + len, *h = buffer + 2 * len;
+
+    memset(ext, border(dilate), len);
+    for (size_t y = begin; y < end; ++y)
+    {
+        memcpy(ext + job->ax, sil_image_data_row8(job->src, y), n);
+
+        for (size_t b = 0; b < len; b += w)
+        {
+            g[b] = ext[b];
+            for (size_t i = b + 1; i < b + w; ++i)
+                g[i] = op(g[i - 1], ext[i], dilate);
+
+            h[b + w - 1] = ext[b + w - 1];
+            for (size_t i = b + w - 1; i-- > b; )
+                h[i] = op(h[i + 1], ext[i], dilate);
+        }
+
+        combine(sil_image_data_row8(job->dst, y), h, g + w - 1, n, dilate);
+    }
+
+    free (buffer);
+}
+
+/*
+ * The same scheme down the columns, done on whole rows at a time. Rows
+ * of the padded image are numbered so that row i is source row i - ay.
+ */
+static void vertical_pass(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    size_t n = sil_image_get_width(job->src);
+    size_t rows = sil_image_get_height(job->src);
+    size_t w = job->height;
+    int dilate = job->dilate;
+
+    size_t first = begin / w * w;
+    size_t last = (end + w - 2) / w * w + w;
+    size_t count = last - first;
+
+    uint8_t *buffer = (uint8_t *) malloc ((2 * count + 1) * n);
+    if (!buffer)
+    {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    uint8_t *g = buffer, *h = buffer + count * n, *empty = buffer + 2 * count * n;
+    memset(empty, border(dilate), n);
+
+    for (size_t b = first; b < last; b += w)
+    {
+        for (size_t i = b; i < b + w; ++i)
+        {
+            const uint8_t *row = i >= job->ay && i - job->ay < rows ?
+                sil_image_data_row8(job->src, i - job->ay) : empty;
+            uint8_t *out = g + (i - first) * n;
+            if (i == b)
+                memcpy(out, row, n);
+            else
+                combine(out, out - n, row, n, dilate);
+        }
+
+        for (size_t i = b + w; i-- > b; )
+        {
+            const uint8_t *row = i >= job->ay && i - job->ay < rows ?
+                sil_image_data_row8(job->src, i - job->ay) : empty;
+            uint8_t *out = h + (i - first) * n;
+            if (i == b + w - 1)
+                memcpy(out, row, n);
+            else
+                combine(out, out + n, row, n, dilate);
+        }
+    }
+
+    for (size_t y = begin; y < end; ++y)
+        combine(sil_image_data_row8(job->dst, y), h + (y - first) * n,
+                g + (y + w - 1 - first) * n, n, dilate);
+
+    free (buffer);
+}
+
+/*
+ * Small element path: each member of the mask contributes one shifted
+ * source row, folded into the output row with a vectorized min or max.
+ */
+static void mask_pass(size_t begin, size_t end, void *arg)
+{
+    struct job *job = (struct job *) arg;
+    size_t n = sil_image_get_width(job->src);
+    size_t rows = sil_image_get_height(job->src);
+    int dilate = job->dilate;
+    size_t len = n + job->width - 1;
+
+    uint8_t *ext = (uint8_t *) malloc (len);
+    if (!ext)
+    {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    memset(ext, border(dilate), len);
+
+    for (size_t y = begin; y < end; ++y)
+    {
+        uint8_t *out = sil_image_data_row8(job->dst, y);
+        memset(out, border(dilate), n);
+
+        for (size_t j = 0; j < job->height; ++j)
+        {
+            // Rows outside the image hold the border, which never wins
+            if (y + j < job->ay || y + j - job->ay >= rows)
+                continue;
+
+            memcpy(ext + job->ax, sil_image_data_row8(job->src, y + j - job->ay), n);
+            for (size_t i = 0; i < job->width; ++i)
+                if (job->mask[j * job->width + i])
+                    combine(out, out, ext + i, n, dilate);
+        }
+    }
+
+    free (ext);
+}
+
+static simage_t *run(const simage_t *src, struct job *job, sil_range_fn fn, size_t grain)
+{
+    size_t width = sil_image_get_width(src);
+    size_t height = sil_image_get_height(src);
+
+    simage_t *dst = sil_image_new(width, height, SIL_IMAGE_GRAY_8);
+    if (!dst)
+        return NULL;
+
+    job->src = src;
+    job->dst = dst;
+    job->failed = 0;
+    sil_parallel_for(height, grain, fn, job);
+
+    if (job->failed)
+    {
+        sil_image_free(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+static simage_t *morph(const simage_t *src, size_t width, size_t height,
+                       size_t ax, size_t ay, int dilate)
+{
+    assert (sil_image_get_type(src) == SIL_IMAGE_GRAY_8);
+    assert (width > 0 && height > 0);
+
+    struct job job = {NULL, NULL, width, height, ax, ay, NULL, dilate, 0};
+
+    if (width == 1 && height == 1)
+        return sil_image_copy(src);
+    if (height == 1)
+        return run(src, &job, horizontal_pass, BAND_ROWS);
+
+    size_t grain = 2 * height > BAND_ROWS ? 2 * height : BAND_ROWS;
+    if (width == 1)
+        return run(src, &job, vertical_pass, grain);
+
+    simage_t *tmp = run(src, &job, horizontal_pass, BAND_ROWS);
+    if (!tmp)
+        return NULL;
+    simage_t *dst = run(tmp, &job, vertical_pass, grain);
+    sil_image_free(tmp);
+    return dst;
+}
+
+simage_t *sil_image_erode(const simage_t *src, size_t width, size_t height)
+{
+    return morph(src, width, height, width / 2, height / 2, 0);
+}
+
+simage_t *sil_image_dilate(const simage_t *src, size_t width, size_t height)
+{
+    return morph(src, width, height, width / 2, height / 2, 1);
+}
+
+static simage_t *compose(const simage_t *src, size_t width, size_t height, int dilate)
+{
+    simage_t *tmp = morph(src, width, height, width / 2, height / 2, dilate);
+    if (!tmp)
+        return NULL;
+    simage_t *dst = morph(tmp, width, height, width - 1 - width / 2,
+                          height - 1 - height / 2, !dilate);
+    sil_image_free(tmp);
+    return dst;
+}
+
+simage_t *sil_image_open(const simage_t *src, size_t width, size_t height)
+{
+    return compose(src, width, height, 0);
+}
+
+simage_t *sil_image_close(const simage_t *src, size_t width, size_t height)
+{
+    return compose(src, width, height, 1);
+}
+
+static simage_t *morph_mask(const simage_t *src, const uint8_t *mask,
+                            size_t width, size_t height, int dilate)
+{
+    assert (sil_image_get_type(src) == SIL_IMAGE_GRAY_8);
+    assert (width > 0 && height > 0);
+
+    struct job job = {NULL, NULL, width, height, width / 2, height / 2, mask, dilate, 0};
+    return run(src, &job, mask_pass, BAND_ROWS);
+}
+
+simage_t *sil_image_erode_mask(const simage_t *src, const uint8_t *mask,
+                               size_t width, size_t height)
+{
+    return morph_mask(src, mask, width, height, 0);
+}
+
+simage_t *sil_image_dilate_mask(const simage_t *src, const uint8_t *mask,
+                                size_t width, size_t height)
+{
+    return morph_mask(src, mask, width, height, 1);
+}
@@ -0,0 +1,388 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// pthread_setaffinity_np
+#define _GNU_SOURCE
+
+#include <sil/parallel.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+// Default side of a tile
+#define TILE_SIZE 64
+
+/*
+ * Each participant owns a contiguous range of the work and takes chunks
+ * from its front; once it is empty it steals chunks from the others in
+ * the same way. Ranges live on their own cache lines.
+ */
+struct range
+{
+    size_t next;
+    size_t end;
+} __attribute__((aligned(CACHE_LINE)));
+
+/*
+ * Jobs wait in a queue until their work is handed out. Submitters work on
+ * their own job while pool threads help the oldest job with work left, so
+ * calls from several threads share the pool instead of waiting in turn.
+ */
+struct job
+{
+    sil_range_fn fn;
+    void *ctx;
+    size_t grain;
+    struct range *ranges;
+    size_t count;
+    // Pool threads inside the job, guarded by the pool lock
+    size_t active;
+    int queued;
+    struct job *next;
+};
+
+struct pool
+{
+    pthread_mutex_t submit;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    pthread_t *threads;
+    size_t nthreads;
+    struct job *head;
+    struct job *tail;
+    int started;
+    int stop;
+};
+
+static struct pool pool = {
+    .submit = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+// Set while running a task, nested calls then run serially
+static __thread int in_task;
+
+// Returns once every chunk of the job has been taken
+static void run_job(struct job *job, size_t self)
+{
+    in_task = 1;
+    for (size_t i = 0; i < job->count; ++i)
+    {
+        struct range *r = &job->ranges[(self + i) % job->count];
+        size_t begin;
+        while ((begin = __atomic_fetch_add(&r->next, job->grain, __ATOMIC_RELAXED)) < r->end)
+        {
+            size_t end = r->end - begin > job->grain ? begin + job->grain : r->end;
+            job->fn(begin, end, job->ctx);
+        }
+    }
+    in_task = 0;
+}
+
+// Both run with the pool lock held
+static void enqueue(struct job *job)
+{
+    job->next = NULL;
+    job->queued = 1;
+    if (pool.tail)
+        pool.tail->next = job;
+    else
+        pool.head = job;
+    pool.tail = job;
+}
+
+static void dequeue(struct job *job)
+{
+    if (!job->queued)
+        return;
+
+    struct job **link = &pool.head;
+    struct job *prev = NULL;
+    while (*link != job)
+    {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    *link = job->next;
+    if (pool.tail == job)
+        pool.tail = prev;
+    job->queued = 0;
+}
+
+static void *worker(void *arg)
+{
+    size_t self = (size_t) arg;
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;)
+    {
+        while (!pool.stop && !pool.head)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        if (pool.stop)
+            break;
+
+        struct job *job = pool.head;
+        ++job->active;
+        pthread_mutex_unlock(&pool.lock);
+
+        run_job(job, self);
+
+        // All the work is handed out, nobody else needs to join the job
+        pthread_mutex_lock(&pool.lock);
+        dequeue(job);
+        if (--job->active == 0)
+            pthread_cond_broadcast(&pool.done);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+// Both helpers run with the submit lock held
+static void stop_pool(void)
+{
+    if (!pool.started)
+        return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (size_t i = 0; i < pool.nthreads; ++i)
+        pthread_join(pool.threads[i], NULL);
+
+    free (pool.threads);
+    pool.threads = NULL;
+    pool.nthreads = 0;
+    pool.stop = 0;
+    pool.started = 0;
+}
+
+static void start_pool(size_t threads, int affinity)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        cpus = 1;
+    if (!threads)
+        threads = cpus;
+
+    // The submitting thread is one of the participants
+    pool.threads = (pthread_t *) malloc (sizeof(pthread_t) * (threads - 1));
+    if (!pool.threads)
+        threads = 1;
+
+    for (size_t i = 0; i < threads - 1; ++i)
+    {
+        if (pthread_create(&pool.threads[i], NULL, worker, (void *) i) != 0)
+            break;
+        ++pool.nthreads;
+
+        if (affinity)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET((i + 1) % cpus, &set);
+            pthread_setaffinity_np(pool.threads[i], sizeof(set), &set);
+        }
+    }
+    __atomic_store_n(&pool.started, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Pool changes must not race with running jobs, init and shutdown are
+ * meant to be called when no other thread uses the library
+ */
+void sil_parallel_init(size_t threads, int affinity)
+{
+    pthread_mutex_lock(&pool.submit);
+    stop_pool();
+    start_pool(threads, affinity);
+    pthread_mutex_unlock(&pool.submit);
+}
+
+void sil_parallel_shutdown(void)
+{
+    pthread_mutex_lock(&pool.submit);
+    stop_pool();
+    pthread_mutex_unlock(&pool.submit);
+}
+
+size_t sil_parallel_threads(void)
+{
+    if (__atomic_load_n(&pool.started, __ATOMIC_ACQUIRE))
+        return pool.nthreads + 1;
+
+    pthread_mutex_lock(&pool.submit);
+    if (!pool.started)
+        start_pool(0, 0);
+    size_t threads = pool.nthreads + 1;
+    pthread_mutex_unlock(&pool.submit);
+    return threads;
+}
+
+static void run_serial(size_t count, size_t grain, sil_range_fn fn, void *ctx)
+{
+    for (size_t begin = 0; begin < count; begin += grain)
+        fn(begin, count - begin > grain ? begin + grain : count, ctx);
+}
+
+void sil_parallel_for(size_t count, size_t grain, sil_range_fn fn, void *ctx)
+{
+    if (!grain)
+        grain = 1;
+    if (in_task || count <= grain)
+    {
+        run_serial(count, grain, fn, ctx);
+        return;
+    }
+
+    size_t n = sil_parallel_threads();
+    if (n == 1)
+    {
+        run_serial(count, grain, fn, ctx);
+        return;
+    }
+
+    // Split the chunks evenly, range limits stay multiples of grain
+    struct range ranges[n];
+    size_t chunks = (count + grain - 1) / grain;
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t end = chunks * (i + 1) / n * grain;
+        ranges[i].next = chunks * i / n * grain;
+        ranges[i].end = end < count ? end : count;
+    }
+
+    struct job job = {fn, ctx, grain, ranges, n, 0, 0, NULL};
+
+    pthread_mutex_lock(&pool.lock);
+    enqueue(&job);
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_job(&job, n - 1);
+
+    // Pool threads may still be finishing the chunks they took
+    pthread_mutex_lock(&pool.lock);
+    dequeue(&job);
+    while (job.active)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+struct image_job
+{
+    simage_t **imgs;
+    size_t count;
+    sil_rows_fn rows_fn;
+    sil_tiles_fn tiles_fn;
+    void *ctx;
+    size_t tile_width;
+    size_t tile_height;
+    size_t tiles_x;
+};
+
+static size_t gcd(size_t a, size_t b)
+{
+    while (b)
+    {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Smallest number of items of the given sizes spanning whole cache lines
+static size_t line_unit(size_t size)
+{
+    return CACHE_LINE / gcd(size, CACHE_LINE);
+}
+
+static void rows_task(size_t begin, size_t end, void *arg)
+{
+    struct image_job *job = (struct image_job *) arg;
+    job->rows_fn(job->imgs, job->count, begin, end - begin, job->ctx);
+}
+
+static void tiles_task(size_t begin, size_t end, void *arg)
+{
+    struct image_job *job = (struct image_job *) arg;
+    size_t width = sil_image_get_width(job->imgs[0]);
+    size_t height = sil_image_get_height(job->imgs[0]);
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        size_t top = i / job->tiles_x * job->tile_height;
+        size_t left = i % job->tiles_x * job->tile_width;
+        size_t w = width - left < job->tile_width ? width - left : job->tile_width;
+        size_t h = height - top < job->tile_height ? height - top : job->tile_height;
+        job->tiles_fn(job->imgs, job->count, top, left, w, h, job->ctx);
+    }
+}
+
+void sil_image_parallel_rows(simage_t **imgs, size_t count, sil_rows_fn fn, void *ctx,
+                             const struct sil_parallel_opts *opts)
+{
+    // All units are powers of two, so the largest is a multiple of the rest
+    size_t unit = 1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t u = line_unit(sil_image_get_stride(imgs[i]));
+        unit = u > unit ? u : unit;
+    }
+
+    size_t grain = opts && opts->grain ? opts->grain
+                   : BAND_BYTES / sil_image_get_stride(imgs[0]) + 1;
+    grain = (grain + unit - 1) / unit * unit;
+
+    struct image_job job = {imgs, count, fn, NULL, ctx, 0, 0, 0};
+    sil_parallel_for(sil_image_get_height(imgs[0]), grain, rows_task, &job);
+}
+
+void sil_image_parallel_tiles(simage_t **imgs, size_t count, sil_tiles_fn fn, void *ctx,
+                              const struct sil_parallel_opts *opts)
+{
+    size_t unit = 1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Binary tiles start on whole bytes too
+        size_t bpp = sil_image_byte_per_pixel(imgs[i]);
+        size_t u = bpp ? line_unit(bpp) : 8 * CACHE_LINE;
+        unit = u > unit ? u : unit;
+    }
+
+    size_t tile_width = opts && opts->tile_width ? opts->tile_width : TILE_SIZE;
+    size_t tile_height = opts && opts->tile_height ? opts->tile_height : TILE_SIZE;
+    tile_width = (tile_width + unit - 1) / unit * unit;
+
+    size_t width = sil_image_get_width(imgs[0]);
+    size_t height = sil_image_get_height(imgs[0]);
+    size_t tiles_x = (width + tile_width - 1) / tile_width;
+    size_t tiles_y = (height + tile_height - 1) / tile_height;
+
+    struct image_job job = {imgs, count, NULL, fn, ctx, tile_width, tile_height, tiles_x};
+    sil_parallel_for(tiles_x * tiles_y, opts && opts->grain ? opts->grain : 1, tiles_task, &job);
+}
@@ -16,10 +16,26 @@
  * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+// fallocate and O_DIRECT
+#define _GNU_SOURCE
+
 #include <sil/pnm.h>
 #include <sil/simage.h>
+#include "internal.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define HEADER_SIZE 64
+
+// The parallel writer works on file chunks aligned for O_DIRECT
+#define DIRECT_ALIGN 4096
+#define CHUNK_SIZE (4 << 20)
 
 static int to_valid_position(FILE *fd)
 {
@@ -97,17 +113,46 @@ static void create_stream(FILE **fd, const char *path, const char *mode)
     }
 }
 
-void sil_pnm_write_stream(const simage_t *img, FILE *fd)
+/*
+ * Types without a PNM representation are written using the nearest
+ * PNM type, converting one row at a time.
+ */
+static stype_t pnm_type(stype_t type)
+{
+    switch (type)
+    {
+        case SIL_IMAGE_RGBA_32:
+            return SIL_IMAGE_RGB_24;
+        case SIL_IMAGE_GRAY_32F:
+            return SIL_IMAGE_GRAY_16;
+        case SIL_IMAGE_RGB_96F:
+            return SIL_IMAGE_RGB_48;
+        default:
+            return type;
+    }
+}
+
+// Rows are converted through a temporary row unless they are already PNM bytes
+static int is_pnm_layout(const simage_t *img)
+{
+    stype_t type = sil_image_get_type(img);
+    if (pnm_type(type) != type)
+        return 0;
+    if (type == SIL_IMAGE_GRAY_16 || type == SIL_IMAGE_RGB_48)
+        return sil_image_get_order(img) == SIL_IMAGE_ORDER_BIG;
+    return 1;
+}
+
+// Format the header of img into header (at least HEADER_SIZE bytes)
+static size_t format_header(const simage_t *img, char *header)
 {
-    size_t width = sil_image_get_width(img);
-    size_t height = sil_image_get_height(img);
     unsigned maxval = 0;
 
     char magick_num[3];
     magick_num[0] = 'P';
     magick_num[2] = 0;
 
-    switch (sil_image_get_type(img))
+    switch (pnm_type(sil_image_get_type(img)))
     {
         case SIL_IMAGE_GRAY_8:
             maxval = 255;
@@ -125,25 +170,260 @@ void sil_pnm_write_stream(const simage_t *img, FILE *fd)
             maxval = 65535;
             magick_num[1] = '6';
             break;
+        case SIL_IMAGE_BINARY:
+            // PBM has no max value
+            return snprintf(header, HEADER_SIZE, "P4\n%zd %zd\n",
+                            sil_image_get_width(img), sil_image_get_height(img));
+        default:
+            break;
     }
-    size_t size = sil_image_byte_per_pixel(img);
 
-    fprintf(fd, "%s\n%zd %zd\n%d\n", magick_num, width, height, maxval);
+    return snprintf(header, HEADER_SIZE, "%s\n%zd %zd\n%d\n", magick_num,
+                    sil_image_get_width(img), sil_image_get_height(img), maxval);
+}
+
+static size_t pnm_row_size(const simage_t *img)
+{
+    size_t width = sil_image_get_width(img);
+
+    switch (pnm_type(sil_image_get_type(img)))
+    {
+        case SIL_IMAGE_GRAY_8:
+            return width;
+        case SIL_IMAGE_GRAY_16:
+            return width * 2;
+        case SIL_IMAGE_RGB_24:
+            return width * 3;
+        case SIL_IMAGE_RGB_48:
+            return width * 6;
+        case SIL_IMAGE_BINARY:
+            return (width + 7) / 8;
+        default:
+            return 0;
+    }
+}
+
+// Temporary row and conversion scratch for images not in PNM layout
+struct pnm_row
+{
+    simage_t *row;
+    float *scratch;
+};
+
+static void new_pnm_row(const simage_t *img, struct pnm_row *row)
+{
+    row->row = NULL;
+    row->scratch = NULL;
+    if (is_pnm_layout(img))
+        return;
+
+    size_t width = sil_image_get_width(img);
+    row->row = sil_image_new(width, 1, pnm_type(sil_image_get_type(img)));
+    row->scratch = (float *) malloc (sizeof(float) * CONVERT_SCRATCH(width));
+    if (!row->row || !row->scratch)
+    {
+        fprintf(stderr, "[ERROR] PNM: cannot allocate image\n");
+        exit(1);
+    }
+}
+
+static void free_pnm_row(struct pnm_row *row)
+{
+    if (row->row)
+        sil_image_free(row->row);
+    free (row->scratch);
+}
+
+// PNM bytes of row y, converted through row when needed
+static const uint8_t *pnm_row(const simage_t *img, size_t y, struct pnm_row *row)
+{
+    if (!row->row)
+        return sil_image_data_row8(img, y);
+
+    sil_image_convert_row_buf(img, y, row->row, 0, row->scratch);
+    return sil_image_data_row8(row->row, 0);
+}
+
+void sil_pnm_write_stream(const simage_t *img, FILE *fd)
+{
+    size_t height = sil_image_get_height(img);
+
+    struct pnm_row row;
+    new_pnm_row(img, &row);
+    size_t size = pnm_row_size(img);
+
+    char header[HEADER_SIZE];
+    format_header(img, header);
+    fputs(header, fd);
 
     for (size_t i = 0; i < height; ++i)
-        fwrite(sil_image_data_row8(img, i), size, width, fd);
+        fwrite(pnm_row(img, i, &row), 1, size, fd);
+
+    free_pnm_row(&row);
 }
 
-simage_t *sil_pnm_read_stream(FILE *fd)
+struct parallel_write
+{
+    const simage_t *img;
+    int fd;
+    int direct;
+    const char *header;
+    size_t header_size;
+    size_t row_size;
+    size_t total;
+    size_t chunks;
+    size_t next;
+    int error;
+};
+
+// Copy the file bytes [pos, pos + len) into buf
+static void gather_chunk(struct parallel_write *w, struct pnm_row *row, uint8_t *buf, size_t pos, size_t len)
+{
+    size_t end = pos + len;
+
+    if (pos < w->header_size)
+    {
+        size_t n = w->header_size - pos < len ? w->header_size - pos : len;
+        memcpy(buf, w->header + pos, n);
+        buf += n;
+        pos += n;
+    }
+
+    while (pos < end)
+    {
+        size_t y = (pos - w->header_size) / w->row_size;
+        size_t offset = (pos - w->header_size) % w->row_size;
+        size_t n = w->row_size - offset < end - pos ? w->row_size - offset : end - pos;
+
+        memcpy(buf, pnm_row(w->img, y, row) + offset, n);
+        buf += n;
+        pos += n;
+    }
+}
+
+static void *parallel_write_worker(void *arg)
+{
+    struct parallel_write *w = (struct parallel_write *) arg;
+
+    void *buf = NULL;
+    if (posix_memalign(&buf, DIRECT_ALIGN, CHUNK_SIZE) != 0)
+    {
+        w->error = 1;
+        return NULL;
+    }
+    struct pnm_row row;
+    new_pnm_row(w->img, &row);
+
+    size_t i;
+    while ((i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED)) < w->chunks)
+    {
+        size_t pos = i * CHUNK_SIZE;
+        size_t len = w->total - pos < CHUNK_SIZE ? w->total - pos : CHUNK_SIZE;
+        gather_chunk(w, &row, buf, pos, len);
+
+        // O_DIRECT needs whole blocks, the padding is truncated afterwards
+        size_t size = len;
+        if (w->direct && size % DIRECT_ALIGN)
+        {
+            size += DIRECT_ALIGN - size % DIRECT_ALIGN;
+            memset((uint8_t *) buf + len, 0, size - len);
+        }
+
+        if (pwrite(w->fd, buf, size, pos) != (ssize_t) size)
+        {
+            w->error = 1;
+            break;
+        }
+    }
+
+    free_pnm_row(&row);
+    free (buf);
+    return NULL;
+}
+
+/*
+ * Every byte of the output has a fixed offset once the header is known, so
+ * the file is preallocated and split in chunks written with pwrite by
+ * several threads. With SIL_PNM_DIRECT the page cache is bypassed if the
+ * file system supports it.
+ */
+void sil_pnm_write_path_parallel(const simage_t *img, const char *path, size_t threads, int flags)
+{
+    char header[HEADER_SIZE];
+    struct parallel_write w;
+
+    w.img = img;
+    w.header = header;
+    w.header_size = format_header(img, header);
+    w.row_size = pnm_row_size(img);
+    w.total = w.header_size + w.row_size * sil_image_get_height(img);
+    w.chunks = (w.total + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    w.next = 0;
+    w.error = 0;
+
+    w.direct = (flags & SIL_PNM_DIRECT) != 0;
+    w.fd = -1;
+    if (w.direct)
+        w.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (w.fd < 0)
+    {
+        w.direct = 0;
+        w.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (w.fd < 0)
+    {
+        fprintf(stderr, "[ERROR] PNM: cannot open file %s\n", path);
+        exit(1);
+    }
+
+    if (fallocate(w.fd, 0, 0, w.total) != 0 && ftruncate(w.fd, w.total) != 0)
+    {
+        fprintf(stderr, "[ERROR] PNM: cannot allocate file %s\n", path);
+        exit(1);
+    }
+
+    if (!threads)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > w.chunks)
+        threads = w.chunks;
+
+    pthread_t *workers = (pthread_t *) malloc (sizeof(pthread_t) * threads);
+    size_t started = 0;
+    for (; workers && started < threads; ++started)
+    {
+        if (pthread_create(&workers[started], NULL, parallel_write_worker, &w) != 0)
+            break;
+    }
+
+    // Without any thread the caller does the work
+    if (!started)
+        parallel_write_worker(&w);
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    free (workers);
+
+    if (w.direct && ftruncate(w.fd, w.total) != 0)
+        w.error = 1;
+    if (close(w.fd) != 0 || w.error)
+    {
+        fprintf(stderr, "[ERROR] PNM: cannot write file %s\n", path);
+        exit(1);
+    }
+}
+
+// Parse a P4/P5/P6 header, leaving fd at the first byte of the pixel data
+static stype_t read_header(FILE *fd, size_t *width, size_t *height)
 {
     char magick_num[3];
     get_magick_numbers(fd, magick_num);
 
-    size_t width = get_value(fd);
-    size_t height = get_value(fd);
+    *width = get_value(fd);
+    *height = get_value(fd);
+    if (magick_num[1] == '4')
+        return SIL_IMAGE_BINARY;
     size_t maxval = get_value(fd);
 
-    stype_t type = 0;
+    stype_t type = SIL_IMAGE_GRAY_8;
 
     switch (magick_num[1])
     {
@@ -176,6 +456,19 @@ simage_t *sil_pnm_read_stream(FILE *fd)
         }
     }
 
+    return type;
+}
+
+simage_t *sil_pnm_read_stream(FILE *fd)
+{
+    return sil_pnm_read_stream_order(fd, SIL_IMAGE_ORDER_BIG);
+}
+
+simage_t *sil_pnm_read_stream_order(FILE *fd, sorder_t order)
+{
+    size_t width, height;
+    stype_t type = read_header(fd, &width, &height);
+
     simage_t *img = sil_image_new(width, height, type);
     if (!img)
     {
@@ -183,22 +476,36 @@ simage_t *sil_pnm_read_stream(FILE *fd)
         exit(1);
     }
 
-    size_t size = sil_image_byte_per_pixel(img);
+    size_t size = sil_image_get_row_bytes(img);
+
+    // Big-endian samples are swapped in place right after each row is read
+    int swap = order != SIL_IMAGE_ORDER_BIG
+        && (type == SIL_IMAGE_GRAY_16 || type == SIL_IMAGE_RGB_48);
+    size_t count = width * sil_image_get_channels(img);
+    sil_image_tag_order(img, order);
 
     for (size_t i = 0; i < height; ++i)
     {
-        if (fread(sil_image_data_row8(img, i), size, width, fd) != width)
+        uint8_t *row = sil_image_data_row8(img, i);
+        if (fread(row, 1, size, fd) != size)
             break;
+        if (swap)
+            swap16(row, row, count);
     }
 
     return img;
 }
 
 simage_t *sil_pnm_read_path(const char *path)
+{
+    return sil_pnm_read_path_order(path, SIL_IMAGE_ORDER_BIG);
+}
+
+simage_t *sil_pnm_read_path_order(const char *path, sorder_t order)
 {
     FILE *fd = NULL;
     create_stream(&fd, path, "r");
-    simage_t *img = sil_pnm_read_stream(fd);
+    simage_t *img = sil_pnm_read_stream_order(fd, order);
     fclose(fd);
     return img;
 }
@@ -210,3 +517,214 @@ void sil_pnm_write_path(const simage_t *img, const char *path)
     sil_pnm_write_stream(img, fd);
     fclose(fd);
 }
+
+struct pnm_update
+{
+    FILE *fd;
+    size_t offset;
+    size_t row_size;
+    simage_t *img;
+    uint8_t *loaded;
+    // Dirty byte span [lo, hi) of each row, empty when lo >= hi
+    size_t *lo;
+    size_t *hi;
+};
+
+supdate_t *sil_pnm_update_open(const char *path)
+{
+    supdate_t *u = (supdate_t *) malloc (sizeof(supdate_t));
+    if (!u)
+    {
+        fprintf(stderr, "[ERROR] PNM: cannot allocate update\n");
+        exit(1);
+    }
+
+    create_stream(&u->fd, path, "r+");
+
+    size_t width, height;
+    stype_t type = read_header(u->fd, &width, &height);
+    u->offset = ftell(u->fd);
+
+    // Pages of rows never loaded are never touched
+    u->img = sil_image_new(width, height, type);
+    u->loaded = (uint8_t *) calloc(height, sizeof(uint8_t));
+    u->lo = (size_t *) malloc (sizeof(size_t) * height);
+    u->hi = (size_t *) calloc(height, sizeof(size_t));
+    if (!u->img || !u->loaded || !u->lo || !u->hi)
+    {
+        fprintf(stderr, "[ERROR] PNM: cannot allocate image\n");
+        exit(1);
+    }
+
+    u->row_size = sil_image_get_row_bytes(u->img);
+    for (size_t i = 0; i < height; ++i)
+        u->lo[i] = u->row_size;
+
+    return u;
+}
+
+simage_t *sil_pnm_update_image(supdate_t *u)
+{
+    return u->img;
+}
+
+// Read bytes [lo, hi) of a row from the file into the image
+static void update_read(supdate_t *u, size_t row, size_t lo, size_t hi)
+{
+    off_t pos = u->offset + row * u->row_size + lo;
+    uint8_t *dst = sil_image_data_row8(u->img, row) + lo;
+    if (pread(fileno(u->fd), dst, hi - lo, pos) != (ssize_t) (hi - lo))
+    {
+        fprintf(stderr, "[ERROR] PNM: cannot read row %zu\n", row);
+        exit(1);
+    }
+}
+
+void sil_pnm_update_load(supdate_t *u, size_t top, size_t height)
+{
+    size_t end = top + height;
+    if (end > sil_image_get_height(u->img))
+        end = sil_image_get_height(u->img);
+
+    for (size_t i = top; i < end; ++i)
+    {
+        if (u->loaded[i])
+            continue;
+
+        update_read(u, i, 0, u->row_size);
+        u->loaded[i] = 1;
+    }
+}
+
+void sil_pnm_update_mark(supdate_t *u, size_t top, size_t left, size_t width, size_t height)
+{
+    size_t lo, hi;
+    if (sil_image_get_type(u->img) == SIL_IMAGE_BINARY)
+    {
+        lo = left / 8;
+        hi = (left + width + 7) / 8;
+    }
+    else
+    {
+        size_t bpp = sil_image_byte_per_pixel(u->img);
+        lo = left * bpp;
+        hi = (left + width) * bpp;
+    }
+    if (hi > u->row_size)
+        hi = u->row_size;
+
+    size_t end = top + height;
+    if (end > sil_image_get_height(u->img))
+        end = sil_image_get_height(u->img);
+
+    for (size_t i = top; i < end; ++i)
+    {
+        /*
+         * Rows keep a single span, the bytes between two separate marks
+         * of a row never loaded are read so they are written back as is
+         */
+        if (!u->loaded[i] && u->lo[i] < u->hi[i])
+        {
+            if (hi < u->lo[i])
+                update_read(u, i, hi, u->lo[i]);
+            else if (lo > u->hi[i])
+                update_read(u, i, u->hi[i], lo);
+        }
+
+        if (lo < u->lo[i])
+            u->lo[i] = lo;
+        if (hi > u->hi[i])
+            u->hi[i] = hi;
+    }
+}
+
+void sil_pnm_update_mark_rows(supdate_t *u, size_t top, size_t height)
+{
+    sil_pnm_update_mark(u, top, 0, sil_image_get_width(u->img), height);
+}
+
+static void update_write(int fd, struct iovec *iov, int count, off_t pos)
+{
+    while (count > 0)
+    {
+        ssize_t done = pwritev(fd, iov, count, pos);
+        if (done < 0)
+        {
+            fprintf(stderr, "[ERROR] PNM: cannot write rows\n");
+            exit(1);
+        }
+        pos += done;
+
+        // Skip what was written, pwritev may stop short
+        while (count > 0 && (size_t) done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (uint8_t *) iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+}
+
+/*
+ * Full dirty rows are contiguous in the file and are gathered into a single
+ * pwritev, partial rows are written as their own span.
+ */
+void sil_pnm_update_commit(supdate_t *u)
+{
+    enum { BATCH = 64 };
+    struct iovec iov[BATCH];
+    int count = 0;
+    off_t run = 0;
+
+    int fd = fileno(u->fd);
+    size_t height = sil_image_get_height(u->img);
+
+    for (size_t i = 0; i < height; ++i)
+    {
+        if (u->lo[i] >= u->hi[i])
+            continue;
+
+        off_t pos = u->offset + i * u->row_size + u->lo[i];
+        int full = u->lo[i] == 0 && u->hi[i] == u->row_size;
+
+        if (count && (!full || count == BATCH
+                      || pos != run + (off_t) (count * u->row_size)))
+        {
+            update_write(fd, iov, count, run);
+            count = 0;
+        }
+
+        iov[count].iov_base = sil_image_data_row8(u->img, i) + u->lo[i];
+        iov[count].iov_len = u->hi[i] - u->lo[i];
+        if (full)
+        {
+            if (!count)
+                run = pos;
+            ++count;
+        }
+        else
+            update_write(fd, iov, 1, pos);
+
+        u->lo[i] = u->row_size;
+        u->hi[i] = 0;
+    }
+
+    if (count)
+        update_write(fd, iov, count, run);
+}
+
+void sil_pnm_update_close(supdate_t *u)
+{
+    sil_pnm_update_commit(u);
+    fclose(u->fd);
+    sil_image_free(u->img);
+    free (u->loaded);
+    free (u->lo);
+    free (u->hi);
+    free (u);
+}
@@ -17,10 +17,15 @@
  */
 
 #include <sil/simage.h>
+#include "internal.h"
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 // Define the word size in bytes
 #ifdef ARCH32
@@ -36,11 +41,16 @@ struct simage
     size_t stride;
     size_t roi;
     stype_t type;
+    sorder_t order;
 #ifdef ARCH32
     uint32_t *data;
 #else
     uint64_t *data;
 #endif
+    // Mapping backing data: a file or the anonymous pages of a large zeroed image
+    void *map;
+    size_t map_size;
+    size_t refs;
 };
 
 static inline size_t bytes_per_pixel(stype_t type)
@@ -55,10 +65,91 @@ static inline size_t bytes_per_pixel(stype_t type)
             return 3;
         case SIL_IMAGE_RGB_48:
             return 6;
+        case SIL_IMAGE_RGBA_32:
+            return 4;
+        case SIL_IMAGE_GRAY_32F:
+            return 4;
+        case SIL_IMAGE_RGB_96F:
+            return 12;
+        case SIL_IMAGE_BINARY:
+            return 0;
     }
     return 0;
 }
 
+static inline size_t channels(stype_t type)
+{
+    switch (type)
+    {
+        case SIL_IMAGE_GRAY_8:
+        case SIL_IMAGE_GRAY_16:
+        case SIL_IMAGE_GRAY_32F:
+        case SIL_IMAGE_BINARY:
+            return 1;
+        case SIL_IMAGE_RGB_24:
+        case SIL_IMAGE_RGB_48:
+        case SIL_IMAGE_RGB_96F:
+            return 3;
+        case SIL_IMAGE_RGBA_32:
+            return 4;
+    }
+    return 0;
+}
+
+static inline size_t row_bytes(stype_t type, size_t width)
+{
+    if (type == SIL_IMAGE_BINARY)
+        return (width + 7) / 8;
+    return width * bytes_per_pixel(type);
+}
+
+static inline int is_16bit(stype_t type)
+{
+    return type == SIL_IMAGE_GRAY_16 || type == SIL_IMAGE_RGB_48;
+}
+
+// NaN fails every comparison and maps to 0
+static inline uint8_t to_u8(float v)
+{
+    if (!(v > 0.0f))
+        return 0;
+    if (v >= 1.0f)
+        return 255;
+    return (uint8_t)(v * 255.0f + 0.5f);
+}
+
+static inline uint16_t to_u16(float v)
+{
+    if (!(v > 0.0f))
+        return 0;
+    if (v >= 1.0f)
+        return 65535;
+    return (uint16_t)(v * 65535.0f + 0.5f);
+}
+
+// 16-bit samples are stored big-endian (as in PNM) unless the image is native
+static inline uint16_t load16(const uint8_t *p, sorder_t order)
+{
+    if (order == SIL_IMAGE_ORDER_NATIVE)
+    {
+        uint16_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    return p[0] << 8 | p[1];
+}
+
+static inline void store16(uint8_t *p, uint16_t v, sorder_t order)
+{
+    if (order == SIL_IMAGE_ORDER_NATIVE)
+    {
+        memcpy(p, &v, sizeof(v));
+        return;
+    }
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
 static simage_t *allocate_image(size_t width, size_t height, stype_t type, int zero)
 {
     simage_t *img = (simage_t *) malloc (sizeof(simage_t));
@@ -67,8 +158,11 @@ static simage_t *allocate_image(size_t width, size_t height, stype_t type, int z
         return NULL;
 
     img->data = 0;
+    img->roi = 0;
+    img->map = NULL;
+    img->refs = 1;
 
-    size_t total = width * bytes_per_pixel(type);
+    size_t total = row_bytes(type, width);
     if (!total)
     {
         sil_image_free(img);
@@ -77,17 +171,26 @@ static simage_t *allocate_image(size_t width, size_t height, stype_t type, int z
     // Amounts of blocks to store an image row
     size_t blocks = total / ARCH_WORD + ((total % ARCH_WORD) != 0);
 
-#ifdef ARCH32
-    if (zero)
-        img->data = (uint32_t *) calloc(blocks * height, sizeof(uint32_t));
-    else
-        img->data = (uint32_t *) malloc (sizeof(uint32_t) * blocks * height);
-#else
-    if (zero)
-        img->data = (uint64_t *) calloc(blocks * height, sizeof(uint64_t));
-    else
-        img->data = (uint64_t *) malloc (sizeof(uint64_t) * blocks * height);
-#endif
+    /*
+     * Cache line aligned rows let threads work on row bands without sharing
+     * lines. Zeroed images of a page or more are mapped instead, so their
+     * pages stay untouched until first written, as with calloc.
+     */
+    void *data = NULL;
+    size_t bytes = blocks * ARCH_WORD * height;
+    if (zero && bytes >= (size_t) sysconf(_SC_PAGESIZE))
+    {
+        data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+            data = NULL;
+        img->map = data;
+        img->map_size = bytes;
+    }
+    else if (posix_memalign(&data, CACHE_LINE, bytes) != 0)
+        data = NULL;
+    else if (zero)
+        memset(data, 0, bytes);
+    img->data = data;
 
     if (!img->data)
     {
@@ -99,6 +202,7 @@ static simage_t *allocate_image(size_t width, size_t height, stype_t type, int z
     img->width = width;
     img->height = height;
     img->type = type;
+    img->order = SIL_IMAGE_ORDER_BIG;
     img->roi = 0;
 
     return img;
@@ -120,7 +224,7 @@ simage_t *sil_image_copy(const simage_t *src)
     if (!dst)
         return NULL;
 
-    size_t bytes = src->width * bytes_per_pixel(src->type);
+    size_t bytes = row_bytes(src->type, src->width);
 
     for (size_t i = 0; i < src->height; ++i)
     {
@@ -130,15 +234,145 @@ simage_t *sil_image_copy(const simage_t *src)
         {
             dst_bytes[j] = src_bytes[j];
         }
+        if (src->type == SIL_IMAGE_BINARY)
+            dst_bytes[bytes - 1] &= tail_mask(src->width);
     }
+    dst->order = src->order;
 
     return dst;
 }
 
+/*
+ * Mapped images keep rows packed (stride = width * bpp) right after a PNM
+ * header, so the backing file is a valid P4/P5/P6 image. The header is padded
+ * with a comment to keep the pixel data cache line aligned.
+ */
+simage_t *sil_image_new_mapped(const char *path, size_t width, size_t height, stype_t type)
+{
+    size_t stride = row_bytes(type, width);
+    if (!stride || !height)
+        return NULL;
+
+    char header[128] = "";
+    size_t header_size = 0;
+    if (type == SIL_IMAGE_BINARY)
+    {
+        char dims[64];
+        int len = snprintf(dims, sizeof(dims), "%zu %zu\n", width, height);
+        size_t used = 3 + 2 + len;
+        size_t pad = (64 - used % 64) % 64;
+
+        header_size = snprintf(header, sizeof(header), "P4\n#%*s\n%s", (int) pad, "", dims);
+    }
+    else if (type == SIL_IMAGE_GRAY_8 || type == SIL_IMAGE_GRAY_16
+        || type == SIL_IMAGE_RGB_24 || type == SIL_IMAGE_RGB_48)
+    {
+        char dims[64];
+        int len = snprintf(dims, sizeof(dims), "%zu %zu\n%d\n", width, height,
+                           is_16bit(type) ? 65535 : 255);
+        size_t used = 3 + 2 + len;
+        size_t pad = (64 - used % 64) % 64;
+
+        header_size = snprintf(header, sizeof(header), "P%c\n#%*s\n%s",
+                               channels(type) == 1 ? '5' : '6', (int) pad, "", dims);
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return NULL;
+
+    // The file is extended with ftruncate so untouched pages stay sparse
+    size_t map_size = header_size + stride * height;
+    if (ftruncate(fd, map_size) != 0
+        || pwrite(fd, header, header_size, 0) != (ssize_t) header_size)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    simage_t *img = (simage_t *) malloc (sizeof(simage_t));
+    if (!img)
+    {
+        munmap(map, map_size);
+        return NULL;
+    }
+
+    img->map = map;
+    img->map_size = map_size;
+    img->data = (void *)((uint8_t *) map + header_size);
+    img->stride = stride;
+    img->width = width;
+    img->height = height;
+    img->type = type;
+    img->order = SIL_IMAGE_ORDER_BIG;
+    img->roi = 0;
+    img->refs = 1;
+
+    return img;
+}
+
+int sil_image_advise(simage_t *img, size_t y, size_t rows, sadvice_t advice)
+{
+    if (!img->map)
+        return 0;
+
+    int flag = MADV_NORMAL;
+    switch (advice)
+    {
+        case SIL_IMAGE_ADVICE_NORMAL:
+            flag = MADV_NORMAL;
+            break;
+        case SIL_IMAGE_ADVICE_SEQUENTIAL:
+            flag = MADV_SEQUENTIAL;
+            break;
+        case SIL_IMAGE_ADVICE_RANDOM:
+            flag = MADV_RANDOM;
+            break;
+        case SIL_IMAGE_ADVICE_WILLNEED:
+            flag = MADV_WILLNEED;
+            break;
+        case SIL_IMAGE_ADVICE_DONTNEED:
+            flag = MADV_DONTNEED;
+            break;
+    }
+
+    // madvise works on whole pages
+    size_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t) sil_image_data_row8(img, y);
+    uintptr_t end = begin + img->stride * rows;
+    begin -= begin % page;
+
+    return madvise((void *) begin, end - begin, flag);
+}
+
+int sil_image_sync(simage_t *img, int wait)
+{
+    if (!img->map)
+        return 0;
+    return msync(img->map, img->map_size, wait ? MS_SYNC : MS_ASYNC);
+}
+
+simage_t *sil_image_ref(simage_t *img)
+{
+    __atomic_add_fetch(&img->refs, 1, __ATOMIC_RELAXED);
+    return img;
+}
+
+// Drops a reference, the image is released with the last one
 void sil_image_free(simage_t *img)
 {
-    img->data -= img->roi;
-    free (img->data);
+    if (__atomic_sub_fetch(&img->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    if (img->map)
+        munmap(img->map, img->map_size);
+    else
+        free ((uint8_t *) img->data - img->roi);
     free (img);
 }
 
@@ -151,17 +385,20 @@ void sil_image_roi(simage_t *img, size_t top, size_t left, size_t width, size_t
         && width <= img->width
         && left + width <= img->width);
 
+    // Binary rows can only be split on byte boundaries
+    assert (img->type != SIL_IMAGE_BINARY || left % 8 == 0);
+
+    // Packed rows of mapped images cannot keep the ROI word aligned
     do
     {
-        img->roi = top * img->stride + left * bytes_per_pixel(img->type);
-        ++left;
+        img->roi = top * img->stride + row_bytes(img->type, left);
+        left += img->type == SIL_IMAGE_BINARY ? 8 : 1;
     }
-    while((img->roi % ARCH_WORD) != 0);
+    while((img->roi % ARCH_WORD) != 0 && (img->stride % ARCH_WORD) == 0);
 
-    img->roi /= ARCH_WORD;
     img->width = width;
     img->height = height;
-    img->data += img->roi;
+    img->data = (void *)((uint8_t *) img->data + img->roi);
 }
 
 void sil_image_zero(simage_t *img)
@@ -169,6 +406,28 @@ void sil_image_zero(simage_t *img)
     memset(img->data, 0, img->stride * img->height);
 }
 
+void sil_image_tag_order(simage_t *img, sorder_t order)
+{
+    img->order = order;
+}
+
+void sil_image_set_order(simage_t *img, sorder_t order)
+{
+    if (img->order == order)
+        return;
+
+    if (is_16bit(img->type))
+    {
+        size_t count = img->width * channels(img->type);
+        for (size_t i = 0; i < img->height; ++i)
+        {
+            uint8_t *row = sil_image_data_row8(img, i);
+            swap16(row, row, count);
+        }
+    }
+    img->order = order;
+}
+
 void sil_image_set_pixel(simage_t *img, size_t x, size_t y, uint64_t value)
 {
     switch (img->type)
@@ -181,8 +440,7 @@ void sil_image_set_pixel(simage_t *img, size_t x, size_t y, uint64_t value)
         case SIL_IMAGE_GRAY_16:
         {
             uint8_t *p = sil_image_data_row8(img, y) + x * bytes_per_pixel(img->type);
-            *p = value >> 8;
-            *(p + 1) = value;
+            store16(p, value, img->order);
             break;
         }
         case SIL_IMAGE_RGB_24:
@@ -197,10 +455,29 @@ void sil_image_set_pixel(simage_t *img, size_t x, size_t y, uint64_t value)
         {
             uint8_t *p = sil_image_data_row8(img, y) + x * bytes_per_pixel(img->type);
 
-            for (int i = 0, j = 40; i < 6; ++i, j -= 8)
+            for (int i = 0, j = 32; i < 3; ++i, j -= 16)
+                store16(p + 2 * i, value >> j, img->order);
+            break;
+        }
+        case SIL_IMAGE_RGBA_32:
+        {
+            uint8_t *p = sil_image_data_row8(img, y) + x * bytes_per_pixel(img->type);
+
+            for (int i = 0, j = 24; i < 4; ++i, j -= 8)
                 *(p + i) = value >> j;
             break;
         }
+        case SIL_IMAGE_BINARY:
+        {
+            uint8_t *p = sil_image_data_row8(img, y) + x / 8;
+            uint8_t bit = 0x80 >> (x % 8);
+            *p = value ? *p | bit : *p & ~bit;
+            break;
+        }
+        case SIL_IMAGE_GRAY_32F:
+        case SIL_IMAGE_RGB_96F:
+            assert (!"float images must use sil_image_set_pixelf");
+            break;
     }
 }
 
@@ -213,7 +490,7 @@ uint64_t sil_image_get_pixel(const simage_t *img, size_t x, size_t y)
         case SIL_IMAGE_GRAY_16:
         {
             uint8_t *p = sil_image_data_row8(img, y) + x * bytes_per_pixel(img->type);
-            return (*p << 8) | *(p + 1);
+            return load16(p, img->order);
         }
         case SIL_IMAGE_RGB_24:
         {
@@ -223,14 +500,313 @@ uint64_t sil_image_get_pixel(const simage_t *img, size_t x, size_t y)
         case SIL_IMAGE_RGB_48:
         {
             uint8_t *p = sil_image_data_row8(img, y) + x * bytes_per_pixel(img->type);
-            uint64_t a1 = *p << 16 | *(p + 1) << 8 | *(p + 2);
-            uint64_t a2 = *(p + 3) << 16  | *(p + 4) << 8 | *(p + 5);
-            return a1 << 24 | a2;
+            uint64_t r = load16(p, img->order);
+            uint64_t g = load16(p + 2, img->order);
+            uint64_t b = load16(p + 4, img->order);
+            return r << 32 | g << 16 | b;
+        }
+        case SIL_IMAGE_RGBA_32:
+        {
+            uint8_t *p = sil_image_data_row8(img, y) + x * bytes_per_pixel(img->type);
+            return (uint64_t)*p << 24 | *(p + 1) << 16 | *(p + 2) << 8 | *(p + 3);
+        }
+        case SIL_IMAGE_BINARY:
+            return sil_image_data_row8(img, y)[x / 8] >> (7 - x % 8) & 1;
+        case SIL_IMAGE_GRAY_32F:
+        case SIL_IMAGE_RGB_96F:
+            assert (!"float images must use sil_image_get_pixelf");
+            break;
+    }
+    return 0;
+}
+
+void sil_image_set_pixelf(simage_t *img, size_t x, size_t y, const float *value)
+{
+    size_t n = channels(img->type);
+    uint8_t *p = sil_image_data_row8(img, y) + x * bytes_per_pixel(img->type);
+
+    switch (img->type)
+    {
+        case SIL_IMAGE_GRAY_8:
+        case SIL_IMAGE_RGB_24:
+        case SIL_IMAGE_RGBA_32:
+            for (size_t i = 0; i < n; ++i)
+                p[i] = to_u8(value[i]);
+            break;
+        case SIL_IMAGE_GRAY_16:
+        case SIL_IMAGE_RGB_48:
+            for (size_t i = 0; i < n; ++i)
+                store16(p + 2 * i, to_u16(value[i]), img->order);
+            break;
+        case SIL_IMAGE_GRAY_32F:
+        case SIL_IMAGE_RGB_96F:
+            memcpy(p, value, n * sizeof(float));
+            break;
+        case SIL_IMAGE_BINARY:
+            sil_image_set_pixel(img, x, y, value[0] < 0.5f);
+            break;
+    }
+}
+
+void sil_image_get_pixelf(const simage_t *img, size_t x, size_t y, float *value)
+{
+    size_t n = channels(img->type);
+    const uint8_t *p = sil_image_data_row8(img, y) + x * bytes_per_pixel(img->type);
+
+    switch (img->type)
+    {
+        case SIL_IMAGE_GRAY_8:
+        case SIL_IMAGE_RGB_24:
+        case SIL_IMAGE_RGBA_32:
+            for (size_t i = 0; i < n; ++i)
+                value[i] = p[i] / 255.0f;
+            break;
+        case SIL_IMAGE_GRAY_16:
+        case SIL_IMAGE_RGB_48:
+            for (size_t i = 0; i < n; ++i)
+                value[i] = load16(p + 2 * i, img->order) / 65535.0f;
+            break;
+        case SIL_IMAGE_GRAY_32F:
+        case SIL_IMAGE_RGB_96F:
+            memcpy(value, p, n * sizeof(float));
+            break;
+        case SIL_IMAGE_BINARY:
+            value[0] = sil_image_get_pixel(img, x, y) ? 0.0f : 1.0f;
+            break;
+    }
+}
+
+/*
+ * Decode a row into normalized float samples, keeping the channel layout
+ * of the source type. Each case is a flat loop over the samples so the
+ * compiler can vectorize it.
+ */
+static void load_row(const simage_t *img, size_t y, float *out)
+{
+    size_t count = img->width * channels(img->type);
+    const uint8_t *row = sil_image_data_row8(img, y);
+
+    switch (img->type)
+    {
+        case SIL_IMAGE_GRAY_8:
+        case SIL_IMAGE_RGB_24:
+        case SIL_IMAGE_RGBA_32:
+            for (size_t i = 0; i < count; ++i)
+                out[i] = row[i] * (1.0f / 255.0f);
+            break;
+        case SIL_IMAGE_GRAY_16:
+        case SIL_IMAGE_RGB_48:
+            if (img->order == SIL_IMAGE_ORDER_NATIVE)
+            {
+                const uint16_t *row16 = sil_image_data_row16(img, y);
+                for (size_t i = 0; i < count; ++i)
+                    out[i] = row16[i] * (1.0f / 65535.0f);
+            }
+            else
+            {
+                for (size_t i = 0; i < count; ++i)
+                    out[i] = (row[2 * i] << 8 | row[2 * i + 1]) * (1.0f / 65535.0f);
+            }
+            break;
+        case SIL_IMAGE_GRAY_32F:
+        case SIL_IMAGE_RGB_96F:
+            memcpy(out, row, count * sizeof(float));
+            break;
+        case SIL_IMAGE_BINARY:
+            for (size_t i = 0; i < count; ++i)
+                out[i] = row[i / 8] >> (7 - i % 8) & 1 ? 0.0f : 1.0f;
+            break;
+    }
+}
+
+static void store_row(simage_t *img, size_t y, const float *in)
+{
+    size_t count = img->width * channels(img->type);
+    uint8_t *row = sil_image_data_row8(img, y);
+
+    switch (img->type)
+    {
+        case SIL_IMAGE_GRAY_8:
+        case SIL_IMAGE_RGB_24:
+        case SIL_IMAGE_RGBA_32:
+            for (size_t i = 0; i < count; ++i)
+                row[i] = to_u8(in[i]);
+            break;
+        case SIL_IMAGE_GRAY_16:
+        case SIL_IMAGE_RGB_48:
+            if (img->order == SIL_IMAGE_ORDER_NATIVE)
+            {
+                uint16_t *row16 = sil_image_data_row16(img, y);
+                for (size_t i = 0; i < count; ++i)
+                    row16[i] = to_u16(in[i]);
+            }
+            else
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    uint16_t v = to_u16(in[i]);
+                    row[2 * i] = v >> 8;
+                    row[2 * i + 1] = v;
+                }
+            }
+            break;
+        case SIL_IMAGE_GRAY_32F:
+        case SIL_IMAGE_RGB_96F:
+            memcpy(row, in, count * sizeof(float));
+            break;
+        case SIL_IMAGE_BINARY:
+        {
+            // Gray values below one half are black, bits past the width are kept
+            size_t bytes = row_bytes(img->type, count);
+            uint8_t last = row[bytes - 1] & ~tail_mask(count);
+            memset(row, 0, bytes);
+            for (size_t i = 0; i < count; ++i)
+                row[i / 8] |= (in[i] < 0.5f) << (7 - i % 8);
+            row[bytes - 1] |= last;
+            break;
+        }
+    }
+}
+
+/*
+ * Map samples between channel layouts: gray is replicated to RGB, RGB is
+ * reduced to gray using BT.601 luma and the alpha channel defaults to opaque.
+ */
+static void remap_channels(const float *in, size_t in_ch, float *out, size_t out_ch, size_t width)
+{
+    if (in_ch == 1)
+    {
+        for (size_t i = 0; i < width; ++i)
+        {
+            for (size_t c = 0; c < out_ch && c < 3; ++c)
+                out[i * out_ch + c] = in[i];
+            if (out_ch == 4)
+                out[i * out_ch + 3] = 1.0f;
         }
     }
+    else if (out_ch == 1)
+    {
+        for (size_t i = 0; i < width; ++i)
+        {
+            const float *p = in + i * in_ch;
+            out[i] = 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2];
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < width; ++i)
+        {
+            for (size_t c = 0; c < 3; ++c)
+                out[i * out_ch + c] = in[i * in_ch + c];
+            if (out_ch == 4)
+                out[i * out_ch + 3] = 1.0f;
+        }
+    }
+}
+
+// Byte shuffles that do not need the float path, returns 0 if not handled
+static int convert_fast(const simage_t *src, size_t src_y, simage_t *dst, size_t dst_y)
+{
+    size_t width = src->width;
+    const uint8_t *s = sil_image_data_row8(src, src_y);
+    uint8_t *d = sil_image_data_row8(dst, dst_y);
+
+    if (src->type == SIL_IMAGE_BINARY && dst->type == SIL_IMAGE_BINARY)
+    {
+        size_t bytes = row_bytes(src->type, width);
+        uint8_t mask = tail_mask(width);
+        uint8_t last = (s[bytes - 1] & mask) | (d[bytes - 1] & ~mask);
+        memcpy(d, s, bytes - 1);
+        d[bytes - 1] = last;
+        return 1;
+    }
+    if (src->type == dst->type)
+    {
+        if (src->order == dst->order || !is_16bit(src->type))
+            memcpy(d, s, width * bytes_per_pixel(src->type));
+        else
+            swap16(d, s, width * channels(src->type));
+        return 1;
+    }
+    if (src->type == SIL_IMAGE_RGB_24 && dst->type == SIL_IMAGE_RGBA_32)
+    {
+        for (size_t i = 0; i < width; ++i)
+        {
+            d[4 * i] = s[3 * i];
+            d[4 * i + 1] = s[3 * i + 1];
+            d[4 * i + 2] = s[3 * i + 2];
+            d[4 * i + 3] = 255;
+        }
+        return 1;
+    }
+    if (src->type == SIL_IMAGE_RGBA_32 && dst->type == SIL_IMAGE_RGB_24)
+    {
+        for (size_t i = 0; i < width; ++i)
+        {
+            d[3 * i] = s[4 * i];
+            d[3 * i + 1] = s[4 * i + 1];
+            d[3 * i + 2] = s[4 * i + 2];
+        }
+        return 1;
+    }
     return 0;
 }
 
+void sil_image_convert_row_buf(const simage_t *src, size_t src_y, simage_t *dst, size_t dst_y, float *buf)
+{
+    if (convert_fast(src, src_y, dst, dst_y))
+        return;
+
+    size_t in_ch = channels(src->type);
+    size_t out_ch = channels(dst->type);
+    load_row(src, src_y, buf);
+    if (in_ch == out_ch)
+    {
+        store_row(dst, dst_y, buf);
+        return;
+    }
+
+    float *remapped = buf + src->width * 4;
+    remap_channels(buf, in_ch, remapped, out_ch, src->width);
+    store_row(dst, dst_y, remapped);
+}
+
+int sil_image_convert_row(const simage_t *src, size_t src_y, simage_t *dst, size_t dst_y)
+{
+    assert (src->width == dst->width);
+
+    if (convert_fast(src, src_y, dst, dst_y))
+        return 0;
+
+    float *buf = (float *) malloc (sizeof(float) * CONVERT_SCRATCH(src->width));
+    if (!buf)
+        return -1;
+    sil_image_convert_row_buf(src, src_y, dst, dst_y, buf);
+    free (buf);
+    return 0;
+}
+
+simage_t *sil_image_convert(const simage_t *src, stype_t type)
+{
+    simage_t *dst = allocate_image(src->width, src->height, type, 0);
+    if (!dst)
+        return NULL;
+
+    float *buf = (float *) malloc (sizeof(float) * CONVERT_SCRATCH(src->width));
+    if (!buf)
+    {
+        sil_image_free(dst);
+        return NULL;
+    }
+
+    dst->order = src->order;
+    for (size_t i = 0; i < src->height; ++i)
+        sil_image_convert_row_buf(src, i, dst, i, buf);
+
+    free (buf);
+    return dst;
+}
+
 inline uint8_t *sil_image_data8(const simage_t *img)
 {
     return (uint8_t *)img->data;
@@ -248,17 +824,22 @@ inline uint32_t *sil_image_data32(const simage_t *img)
 
 inline uint8_t *sil_image_data_row8(const simage_t *img, size_t y)
 {
-    return (uint8_t *)(img->data + img->stride * y / ARCH_WORD);
+    return (uint8_t *)((uint8_t *) img->data + img->stride * y);
 }
 
 inline uint16_t *sil_image_data_row16(const simage_t *img, size_t y)
 {
-    return (uint16_t *)(img->data + img->stride * y / ARCH_WORD);
+    return (uint16_t *)((uint8_t *) img->data + img->stride * y);
 }
 
 inline uint32_t *sil_image_data_row32(const simage_t *img, size_t y)
 {
-    return (uint32_t *)(img->data + img->stride * y / ARCH_WORD);
+    return (uint32_t *)((uint8_t *) img->data + img->stride * y);
+}
+
+inline float *sil_image_data_rowf(const simage_t *img, size_t y)
+{
+    return (float *)((uint8_t *) img->data + img->stride * y);
 }
 
 inline size_t sil_image_get_width(const simage_t *img)
@@ -281,8 +862,23 @@ inline size_t sil_image_byte_per_pixel(const simage_t *img)
     return bytes_per_pixel(img->type);
 }
 
+inline size_t sil_image_get_row_bytes(const simage_t *img)
+{
+    return row_bytes(img->type, img->width);
+}
+
+inline size_t sil_image_get_channels(const simage_t *img)
+{
+    return channels(img->type);
+}
+
 inline stype_t sil_image_get_type(const simage_t *img)
 {
     return img->type;
 }
 
+inline sorder_t sil_image_get_order(const simage_t *img)
+{
+    return img->order;
+}
+
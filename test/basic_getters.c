@@ -27,14 +27,17 @@
 #include <time.h>
 #include <stdlib.h>
 
-#define TYPES 4
+#define TYPES 7
 
 stype_t types[] = {SIL_IMAGE_GRAY_8,
                    SIL_IMAGE_GRAY_16,
                    SIL_IMAGE_RGB_24,
-                   SIL_IMAGE_RGB_48};
+                   SIL_IMAGE_RGB_48,
+                   SIL_IMAGE_RGBA_32,
+                   SIL_IMAGE_GRAY_32F,
+                   SIL_IMAGE_RGB_96F};
 
-size_t bpp[] = {1, 2, 3, 6};
+size_t bpp[] = {1, 2, 3, 6, 4, 4, 12};
 
 int main()
 {
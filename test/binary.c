@@ -0,0 +1,220 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test thresholds gray images into binary masks, combines them with
+ * the bitwise operations and round trips them through P4 files
+ */
+
+#include <sil/simage.h>
+#include <sil/binary.h>
+#include <sil/compare.h>
+#include <sil/parallel.h>
+#include <sil/pnm.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WIDTH 301
+#define HEIGHT 97
+
+static int check_threshold(const simage_t *src, const simage_t *mask, uint16_t threshold)
+{
+    if (!mask || sil_image_get_type(mask) != SIL_IMAGE_BINARY)
+    {
+        perror("[ERROR] binary: threshold failed\n");
+        return 0;
+    }
+
+    for (size_t y = 0; y < HEIGHT; ++y)
+        for (size_t x = 0; x < WIDTH; ++x)
+            if (sil_image_get_pixel(mask, x, y) != (sil_image_get_pixel(src, x, y) < threshold))
+            {
+                perror("[ERROR] binary: wrong threshold bit\n");
+                return 0;
+            }
+    return 1;
+}
+
+static int check_adaptive(const simage_t *src, const simage_t *mask, long r, long offset)
+{
+    if (!mask)
+    {
+        perror("[ERROR] binary: adaptive threshold failed\n");
+        return 0;
+    }
+
+    for (long y = 0; y < HEIGHT; ++y)
+        for (long x = 0; x < WIDTH; ++x)
+        {
+            long sum = 0, area = 0;
+            for (long j = y - r; j <= y + r; ++j)
+                for (long i = x - r; i <= x + r; ++i)
+                    if (i >= 0 && j >= 0 && i < WIDTH && j < HEIGHT)
+                    {
+                        sum += sil_image_get_pixel(src, i, j);
+                        ++area;
+                    }
+            long v = sil_image_get_pixel(src, x, y);
+            if (sil_image_get_pixel(mask, x, y) != (v * area < sum - offset * area))
+            {
+                perror("[ERROR] binary: wrong adaptive threshold bit\n");
+                return 0;
+            }
+        }
+    return 1;
+}
+
+int main()
+{
+    sil_parallel_init(4, 0);
+    srand(time(NULL));
+
+    // Two populations around 60 and 190 for Otsu to separate
+    simage_t *gray = sil_image_new(WIDTH, HEIGHT, SIL_IMAGE_GRAY_8);
+    simage_t *gray16 = sil_image_new(WIDTH, HEIGHT, SIL_IMAGE_GRAY_16);
+    if (!gray || !gray16)
+    {
+        perror("[ERROR] binary: cannot allocate image\n");
+        return 1;
+    }
+    for (size_t y = 0; y < HEIGHT; ++y)
+        for (size_t x = 0; x < WIDTH; ++x)
+        {
+            uint8_t v = (rand() % 2 ? 60 : 190) + rand() % 21 - 10;
+            sil_image_set_pixel(gray, x, y, v);
+            sil_image_set_pixel(gray16, x, y, v * 257);
+        }
+
+    simage_t *a = sil_image_threshold(gray, 128);
+    if (!check_threshold(gray, a, 128))
+        return 1;
+
+    sil_image_set_order(gray16, SIL_IMAGE_ORDER_NATIVE);
+    simage_t *a16 = sil_image_threshold(gray16, 128 * 257);
+    if (!check_threshold(gray16, a16, 128 * 257))
+        return 1;
+    if (!sil_image_equal(a, a16))
+    {
+        perror("[ERROR] binary: 8 and 16-bit thresholds differ\n");
+        return 1;
+    }
+
+    int otsu = sil_image_otsu(gray);
+    if (otsu <= 70 || otsu > 180)
+    {
+        perror("[ERROR] binary: otsu threshold outside the gap\n");
+        return 1;
+    }
+    simage_t *o = sil_image_threshold_otsu(gray);
+    if (!sil_image_equal(a, o))
+    {
+        perror("[ERROR] binary: otsu mask differs\n");
+        return 1;
+    }
+
+    simage_t *b = sil_image_threshold_adaptive(gray, 3, 5);
+    if (!check_adaptive(gray, b, 3, 5))
+        return 1;
+    simage_t *b16 = sil_image_threshold_adaptive(gray16, 2, -300);
+    if (!check_adaptive(gray16, b16, 2, -300))
+        return 1;
+
+    // Bitwise operations against the pixels of both masks
+    simage_t *ops[4] = {sil_image_and(a, b), sil_image_or(a, b),
+                        sil_image_xor(a, b), sil_image_not(a)};
+    uint64_t count = 0;
+    for (size_t y = 0; y < HEIGHT; ++y)
+        for (size_t x = 0; x < WIDTH; ++x)
+        {
+            uint64_t pa = sil_image_get_pixel(a, x, y);
+            uint64_t pb = sil_image_get_pixel(b, x, y);
+            count += pa;
+            if (sil_image_get_pixel(ops[0], x, y) != (pa & pb)
+                || sil_image_get_pixel(ops[1], x, y) != (pa | pb)
+                || sil_image_get_pixel(ops[2], x, y) != (pa ^ pb)
+                || sil_image_get_pixel(ops[3], x, y) != !pa)
+            {
+                perror("[ERROR] binary: wrong bitwise result\n");
+                return 1;
+            }
+        }
+
+    if (sil_image_popcount(a) != count
+        || sil_image_popcount(ops[3]) != (uint64_t) WIDTH * HEIGHT - count)
+    {
+        perror("[ERROR] binary: wrong popcount\n");
+        return 1;
+    }
+
+    // A ROI not ending on a byte keeps the pixels of its parent in the tail bits
+    simage_t *roi = sil_image_copy(a);
+    sil_image_roi(roi, 3, 16, 21, 50);
+    simage_t *part = sil_image_copy(roi);
+    if (!sil_image_equal(roi, part) || sil_image_popcount(roi) != sil_image_popcount(part))
+    {
+        perror("[ERROR] binary: ROI copy differs\n");
+        return 1;
+    }
+
+    char path[] = "/tmp/sil_binaryXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("[ERROR] binary: cannot create file\n");
+        return 1;
+    }
+    close(fd);
+
+    sil_pnm_write_path(a, path);
+    simage_t *back = sil_pnm_read_path(path);
+    if (sil_image_get_type(back) != SIL_IMAGE_BINARY || !sil_image_equal(a, back))
+    {
+        perror("[ERROR] binary: P4 round trip differs\n");
+        return 1;
+    }
+
+    sil_pnm_write_path(part, path);
+    simage_t *back_part = sil_pnm_read_path(path);
+    if (!sil_image_equal(part, back_part))
+    {
+        perror("[ERROR] binary: P4 round trip of a ROI differs\n");
+        return 1;
+    }
+    unlink(path);
+
+    for (int i = 0; i < 4; ++i)
+        sil_image_free(ops[i]);
+    sil_image_free(back_part);
+    sil_image_free(back);
+    sil_image_free(part);
+    sil_image_free(roi);
+    sil_image_free(b16);
+    sil_image_free(b);
+    sil_image_free(o);
+    sil_image_free(a16);
+    sil_image_free(a);
+    sil_image_free(gray16);
+    sil_image_free(gray);
+    sil_parallel_shutdown();
+    printf("Test binary [OK]\n");
+    return 0;
+}
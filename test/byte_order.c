@@ -0,0 +1,121 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test writes 16-bit images as PNM and reads them back in native
+ * byte order, then checks the samples can be used directly
+ */
+
+#include <sil/simage.h>
+#include <sil/pnm.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WIDTH 23
+#define HEIGHT 20
+#define TYPES 2
+
+stype_t types[] = {SIL_IMAGE_GRAY_16,
+                   SIL_IMAGE_RGB_48};
+
+int main()
+{
+    srand(time(NULL));
+
+    for (int k = 0; k < TYPES; ++k)
+    {
+        simage_t *img = sil_image_new(WIDTH, HEIGHT, types[k]);
+        FILE *fd = tmpfile();
+        if (!img || !fd)
+        {
+            perror("[ERROR] byte_order: cannot allocate image\n");
+            return 1;
+        }
+
+        size_t channels = sil_image_get_channels(img);
+        for (size_t i = 0; i < HEIGHT; ++i)
+        {
+            for (size_t j = 0; j < WIDTH; ++j)
+            {
+                uint64_t color = 0;
+                for (size_t c = 0; c < channels; ++c)
+                    color = (color << 16) | (rand() & 0xffff);
+                sil_image_set_pixel(img, j, i, color);
+            }
+        }
+
+        sil_pnm_write_stream(img, fd);
+        simage_t *native = sil_pnm_read_stream_order(fd, SIL_IMAGE_ORDER_NATIVE);
+
+        if (sil_image_get_order(native) != SIL_IMAGE_ORDER_NATIVE)
+        {
+            perror("[ERROR] byte_order: order mismatch\n");
+            return 1;
+        }
+
+        for (size_t i = 0; i < HEIGHT; ++i)
+        {
+            uint16_t *row = sil_image_data_row16(native, i);
+            for (size_t j = 0; j < WIDTH; ++j)
+            {
+                uint64_t color = sil_image_get_pixel(img, j, i);
+                uint64_t value = 0;
+                for (size_t c = 0; c < channels; ++c)
+                    value = (value << 16) | row[j * channels + c];
+
+                if (color != value || color != sil_image_get_pixel(native, j, i))
+                {
+                    perror("[ERROR] byte_order: sample mismatch\n");
+                    return 1;
+                }
+            }
+        }
+
+        // Writing a native image must give back the same file
+        FILE *out = tmpfile();
+        sil_pnm_write_stream(native, out);
+        sil_image_set_order(native, SIL_IMAGE_ORDER_BIG);
+        simage_t *back = sil_pnm_read_stream(out);
+
+        for (size_t i = 0; i < HEIGHT; ++i)
+        {
+            for (size_t j = 0; j < WIDTH; ++j)
+            {
+                uint64_t color = sil_image_get_pixel(img, j, i);
+                if (color != sil_image_get_pixel(back, j, i)
+                    || color != sil_image_get_pixel(native, j, i))
+                {
+                    perror("[ERROR] byte_order: pixel mismatch after write\n");
+                    return 1;
+                }
+            }
+        }
+
+        fclose(out);
+        fclose(fd);
+        sil_image_free(back);
+        sil_image_free(native);
+        sil_image_free(img);
+    }
+
+    printf("Test byte_order [OK]\n");
+    return 0;
+}
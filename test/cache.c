@@ -0,0 +1,163 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test loads images through the cache and checks hits, reloads of
+ * modified files, the shared budget and the eviction order
+ */
+
+#include <sil/simage.h>
+#include <sil/pnm.h>
+#include <sil/cache.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define WIDTH 40
+#define HEIGHT 30
+
+// Several pages of pixels each, far more than a 16th of the budget
+#define BIG_WIDTH 600
+#define BIG_HEIGHT 400
+#define BIG_BYTES (BIG_WIDTH * BIG_HEIGHT)
+#define FILES 5
+
+static void write_image(const char *path, size_t width, size_t height, uint64_t color)
+{
+    simage_t *img = sil_image_new(width, height, SIL_IMAGE_GRAY_8);
+    for (size_t i = 0; i < height; ++i)
+        for (size_t j = 0; j < width; ++j)
+            sil_image_set_pixel(img, j, i, color);
+    sil_pnm_write_path(img, path);
+    sil_image_free(img);
+}
+
+int main()
+{
+    char path[] = "/tmp/sil_cacheXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("[ERROR] cache: cannot create file\n");
+        return 1;
+    }
+    close(fd);
+    write_image(path, WIDTH, HEIGHT, 7);
+
+    scache_t *cache = sil_cache_new(1 << 20);
+    const simage_t *a = sil_cache_get(cache, path);
+    const simage_t *b = sil_cache_get(cache, path);
+    struct sil_cache_stats stats;
+    sil_cache_stats(cache, &stats);
+
+    if (!a || a != b || stats.hits != 1 || stats.misses != 1 || stats.entries != 1
+        || sil_image_get_pixel(a, 3, 4) != 7)
+    {
+        perror("[ERROR] cache: no hit for the same file\n");
+        return 1;
+    }
+    sil_cache_release(b);
+
+    // A different size means a different file
+    write_image(path, WIDTH + 1, HEIGHT, 9);
+    b = sil_cache_get(cache, path);
+    sil_cache_stats(cache, &stats);
+    if (!b || b == a || stats.misses != 2 || stats.entries != 1
+        || sil_image_get_pixel(b, 3, 4) != 9 || sil_image_get_pixel(a, 3, 4) != 7)
+    {
+        perror("[ERROR] cache: modified file not reloaded\n");
+        return 1;
+    }
+    sil_cache_release(a);
+    sil_cache_release(b);
+
+    if (sil_cache_get(cache, "/nonexistent/sil_cache.pgm"))
+    {
+        perror("[ERROR] cache: missing file found\n");
+        return 1;
+    }
+    sil_cache_free(cache);
+
+    // Without budget every image is evicted, handles stay valid
+    cache = sil_cache_new(0);
+    a = sil_cache_get(cache, path);
+    sil_cache_stats(cache, &stats);
+    if (stats.evictions != 1 || stats.entries != 0 || sil_image_get_pixel(a, 3, 4) != 9)
+    {
+        perror("[ERROR] cache: image not evicted\n");
+        return 1;
+    }
+    sil_cache_release(a);
+    sil_cache_free(cache);
+    unlink(path);
+
+    char paths[FILES][32];
+    for (int i = 0; i < FILES; ++i)
+    {
+        snprintf(paths[i], sizeof(paths[i]), "/tmp/sil_cacheXXXXXX");
+        fd = mkstemp(paths[i]);
+        if (fd < 0)
+        {
+            perror("[ERROR] cache: cannot create file\n");
+            return 1;
+        }
+        close(fd);
+        write_image(paths[i], BIG_WIDTH, BIG_HEIGHT, i);
+    }
+
+    // Every image fits the budget and is decoded once
+    cache = sil_cache_new(2 << 20);
+    for (int k = 0; k < 3; ++k)
+        for (int i = 0; i < FILES; ++i)
+            sil_cache_release(sil_cache_get(cache, paths[i]));
+    sil_cache_stats(cache, &stats);
+    if (stats.hits != 2 * FILES || stats.misses != FILES || stats.evictions != 0
+        || stats.entries != FILES || stats.bytes != FILES * BIG_BYTES)
+    {
+        perror("[ERROR] cache: images evicted under budget\n");
+        return 1;
+    }
+    sil_cache_free(cache);
+
+    /*
+     * Room for three images: the fourth evicts one of the first three and
+     * clears the others, so the fifth must evict an unreferenced image
+     * and keep the fourth, which was used again
+     */
+    cache = sil_cache_new(3 * BIG_BYTES);
+    for (int i = 0; i < 4; ++i)
+        sil_cache_release(sil_cache_get(cache, paths[i]));
+    sil_cache_release(sil_cache_get(cache, paths[3]));
+    sil_cache_release(sil_cache_get(cache, paths[4]));
+    sil_cache_release(sil_cache_get(cache, paths[3]));
+    sil_cache_release(sil_cache_get(cache, paths[4]));
+    sil_cache_stats(cache, &stats);
+    if (stats.evictions != 2 || stats.entries != 3 || stats.misses != 5 || stats.hits != 3)
+    {
+        perror("[ERROR] cache: wrong eviction order\n");
+        return 1;
+    }
+    sil_cache_free(cache);
+
+    for (int i = 0; i < FILES; ++i)
+        unlink(paths[i]);
+    printf("Test cache [OK]\n");
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test converts random images to planar YCbCr and HSV and back,
+ * checking the error stays within the fixed point rounding
+ */
+
+#include <sil/simage.h>
+#include <sil/colorspace.h>
+#include <sil/compare.h>
+#include <sil/parallel.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WIDTH 641
+#define HEIGHT 481
+
+static uint64_t hash(uint64_t v)
+{
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33;
+    return v;
+}
+
+// With a block seed the color is constant over each 2x2 block
+static void fill(simage_t *img, uint64_t blocks)
+{
+    uint64_t mask = sil_image_byte_per_pixel(img) == 6 ? 0xffffffffffffULL : 0xffffff;
+    for (size_t i = 0; i < HEIGHT; ++i)
+    {
+        for (size_t j = 0; j < WIDTH; ++j)
+        {
+            uint64_t color = blocks ? hash((i / 2) * WIDTH + j / 2 + blocks) : hash(rand());
+            sil_image_set_pixel(img, j, i, color & mask);
+        }
+    }
+}
+
+static int round_trip(stype_t type, smatrix_t matrix, srange_t range, schroma_t chroma, double limit)
+{
+    simage_t *img = sil_image_new(WIDTH, HEIGHT, type);
+    simage_t *back = sil_image_new(WIDTH, HEIGHT, type);
+    int wide = type == SIL_IMAGE_RGB_48 ? 2 : 1;
+    size_t cw = chroma == SIL_CHROMA_444 ? WIDTH : (WIDTH + 1) / 2;
+    size_t ch = chroma == SIL_CHROMA_420 ? (HEIGHT + 1) / 2 : HEIGHT;
+
+    struct sil_planar planes;
+    planes.plane[0] = malloc(WIDTH * HEIGHT * wide);
+    planes.plane[1] = malloc(cw * ch * wide);
+    planes.plane[2] = malloc(cw * ch * wide);
+    planes.stride[0] = WIDTH * wide;
+    planes.stride[1] = planes.stride[2] = cw * wide;
+
+    fill(img, chroma == SIL_CHROMA_444 ? 0 : rand() + 1);
+    int status = sil_image_to_ycbcr(img, &planes, matrix, range, chroma);
+    if (!status)
+        status = sil_image_from_ycbcr(&planes, back, matrix, range, chroma);
+
+    double error = status ? limit + 1 : sil_image_max_error(img, back, NULL, NULL);
+
+    free (planes.plane[0]);
+    free (planes.plane[1]);
+    free (planes.plane[2]);
+    sil_image_free(back);
+    sil_image_free(img);
+    return error <= limit;
+}
+
+int main()
+{
+    srand(time(NULL));
+
+    // Force several threads so the row bands run concurrently
+    sil_parallel_init(4, 0);
+
+    // Reference values for white
+    simage_t *white = sil_image_new(2, 2, SIL_IMAGE_RGB_24);
+    for (size_t i = 0; i < 4; ++i)
+        sil_image_set_pixel(white, i % 2, i / 2, 0xffffff);
+    uint8_t y[4], cb, cr;
+    struct sil_planar planes = {{y, &cb, &cr}, {2, 1, 1}};
+    if (sil_image_to_ycbcr(white, &planes, SIL_COLOR_BT709, SIL_COLOR_LIMITED, SIL_CHROMA_420)
+        || y[0] != 235 || y[3] != 235 || cb != 128 || cr != 128)
+    {
+        perror("[ERROR] colorspace: wrong limited range white\n");
+        return 1;
+    }
+    sil_image_free(white);
+
+    if (!round_trip(SIL_IMAGE_RGB_24, SIL_COLOR_BT601, SIL_COLOR_FULL, SIL_CHROMA_444, 2)
+        || !round_trip(SIL_IMAGE_RGB_24, SIL_COLOR_BT709, SIL_COLOR_LIMITED, SIL_CHROMA_444, 3)
+        || !round_trip(SIL_IMAGE_RGB_48, SIL_COLOR_BT709, SIL_COLOR_FULL, SIL_CHROMA_444, 2)
+        || !round_trip(SIL_IMAGE_RGB_48, SIL_COLOR_BT601, SIL_COLOR_LIMITED, SIL_CHROMA_444, 8)
+        || !round_trip(SIL_IMAGE_RGB_24, SIL_COLOR_BT601, SIL_COLOR_FULL, SIL_CHROMA_422, 2)
+        || !round_trip(SIL_IMAGE_RGB_24, SIL_COLOR_BT709, SIL_COLOR_LIMITED, SIL_CHROMA_420, 3))
+    {
+        perror("[ERROR] colorspace: YCbCr round trip error\n");
+        return 1;
+    }
+
+    simage_t *img = sil_image_new(WIDTH, HEIGHT, SIL_IMAGE_RGB_24);
+    fill(img, 0);
+    simage_t *hsv = sil_image_rgb_to_hsv(img);
+    simage_t *back = hsv ? sil_image_hsv_to_rgb(hsv, SIL_IMAGE_RGB_24) : NULL;
+    if (!back || sil_image_max_error(img, back, NULL, NULL) > 1)
+    {
+        perror("[ERROR] colorspace: HSV round trip error\n");
+        return 1;
+    }
+    sil_image_free(back);
+    sil_image_free(hsv);
+    sil_image_free(img);
+
+    printf("Test colorspace [OK]\n");
+    return 0;
+}
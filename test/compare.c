@@ -0,0 +1,140 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test compares images with known differences and checks the
+ * equality, absolute difference and error metrics
+ */
+
+#include <sil/simage.h>
+#include <sil/compare.h>
+#include <sil/parallel.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#define WIDTH 1200
+#define HEIGHT 1100
+#define TYPES 4
+
+stype_t types[] = {SIL_IMAGE_GRAY_8,
+                   SIL_IMAGE_GRAY_16,
+                   SIL_IMAGE_RGB_24,
+                   SIL_IMAGE_GRAY_32F};
+
+int main()
+{
+    srand(time(NULL));
+
+    // Force several threads so the row bands run concurrently
+    sil_parallel_init(4, 0);
+
+    for (int k = 0; k < TYPES; ++k)
+    {
+        simage_t *a = sil_image_zero_new(WIDTH, HEIGHT, types[k]);
+        if (!a)
+        {
+            perror("[ERROR] compare: cannot allocate image\n");
+            return 1;
+        }
+
+        float gray = 0.5f;
+        for (size_t i = 0; i < HEIGHT; ++i)
+            for (size_t j = 0; j < WIDTH; ++j)
+                if (types[k] == SIL_IMAGE_GRAY_32F)
+                    sil_image_set_pixelf(a, j, i, &gray);
+                else
+                    sil_image_set_pixel(a, j, i, 100);
+
+        simage_t *b = sil_image_copy(a);
+        if (!sil_image_equal(a, b) || sil_image_mse(a, b) != 0
+            || !isinf(sil_image_psnr(a, b)))
+        {
+            perror("[ERROR] compare: copy is not equal\n");
+            return 1;
+        }
+
+        // One pixel off by a known amount
+        size_t x = rand() % WIDTH;
+        size_t y = rand() % HEIGHT;
+        double error = 10;
+        if (types[k] == SIL_IMAGE_GRAY_32F)
+        {
+            float value = 0.25f;
+            sil_image_set_pixelf(b, x, y, &value);
+            error = 0.25;
+        }
+        else
+            sil_image_set_pixel(b, x, y, 90);
+
+        size_t ex, ey;
+        if (sil_image_equal(a, b)
+            || sil_image_max_error(a, b, &ex, &ey) != error
+            || ex != x || ey != y)
+        {
+            perror("[ERROR] compare: wrong maximum error\n");
+            return 1;
+        }
+
+        size_t samples = WIDTH * HEIGHT * sil_image_get_channels(a);
+        double mse = error * error / samples;
+        if (fabs(sil_image_mse(a, b) - mse) > 1e-12)
+        {
+            perror("[ERROR] compare: wrong mse\n");
+            return 1;
+        }
+
+        simage_t *diff = sil_image_absdiff(a, b);
+        simage_t *zero = sil_image_zero_new(WIDTH, HEIGHT, types[k]);
+        if (sil_image_max_error(diff, zero, &ex, &ey) != error || ex != x || ey != y)
+        {
+            perror("[ERROR] compare: wrong absolute difference\n");
+            return 1;
+        }
+
+        sil_image_free(zero);
+        sil_image_free(diff);
+        sil_image_free(b);
+        sil_image_free(a);
+    }
+
+    // Byte order must not matter
+    simage_t *a = sil_image_zero_new(WIDTH, 3, SIL_IMAGE_RGB_48);
+    sil_image_set_pixel(a, 7, 1, 0x123456789abcULL);
+    simage_t *b = sil_image_copy(a);
+    sil_image_set_order(b, SIL_IMAGE_ORDER_NATIVE);
+    if (!sil_image_equal(a, b) || !sil_image_equal(b, a))
+    {
+        perror("[ERROR] compare: byte order mismatch\n");
+        return 1;
+    }
+    sil_image_set_pixel(b, WIDTH - 1, 2, 1);
+    if (sil_image_equal(a, b) || sil_image_equal(b, a))
+    {
+        perror("[ERROR] compare: byte order hides a difference\n");
+        return 1;
+    }
+    sil_image_free(b);
+    sil_image_free(a);
+
+    printf("Test compare [OK]\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test fills images with random pixels, converts them to the
+ * SIMD friendly types and back, and checks nothing was lost
+ */
+
+#include <sil/simage.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#define WIDTH 37
+#define HEIGHT 20
+#define TYPES 3
+
+stype_t from[] = {SIL_IMAGE_RGB_24,
+                  SIL_IMAGE_GRAY_8,
+                  SIL_IMAGE_RGB_48};
+
+stype_t to[] = {SIL_IMAGE_RGBA_32,
+                SIL_IMAGE_GRAY_32F,
+                SIL_IMAGE_RGB_96F};
+
+static uint64_t get_color(int bpp)
+{
+    uint64_t color = 0;
+    for (int i = 0; i < bpp; ++i)
+        color = (color << 8) | rand() % 0xff;
+    return color;
+}
+
+int main()
+{
+    srand(time(NULL));
+
+    for (int k = 0; k < TYPES; ++k)
+    {
+        simage_t *img = sil_image_new(WIDTH, HEIGHT, from[k]);
+        if (!img)
+        {
+            perror("[ERROR] convert: cannot allocate image\n");
+            return 1;
+        }
+
+        for (size_t i = 0; i < HEIGHT; ++i)
+            for (size_t j = 0; j < WIDTH; ++j)
+                sil_image_set_pixel(img, j, i, get_color((int) sil_image_byte_per_pixel(img)));
+
+        simage_t *conv = sil_image_convert(img, to[k]);
+        simage_t *back = conv ? sil_image_convert(conv, from[k]) : NULL;
+        if (!back)
+        {
+            perror("[ERROR] convert: cannot convert image\n");
+            return 1;
+        }
+
+        for (size_t i = 0; i < HEIGHT; ++i)
+        {
+            for (size_t j = 0; j < WIDTH; ++j)
+            {
+                if (sil_image_get_pixel(img, j, i) != sil_image_get_pixel(back, j, i))
+                {
+                    perror("[ERROR] convert: pixel mismatch\n");
+                    return 1;
+                }
+            }
+        }
+
+        sil_image_free(back);
+        sil_image_free(conv);
+        sil_image_free(img);
+    }
+
+    // Float accessors
+    simage_t *img = sil_image_zero_new(WIDTH, HEIGHT, SIL_IMAGE_RGB_96F);
+    float in[3] = {0.25f, 0.5f, 1.0f};
+    float out[3];
+    sil_image_set_pixelf(img, 3, 4, in);
+    sil_image_get_pixelf(img, 3, 4, out);
+    if (in[0] != out[0] || in[1] != out[1] || in[2] != out[2]
+        || sil_image_data_rowf(img, 4)[10] != in[1])
+    {
+        perror("[ERROR] convert: float pixel mismatch\n");
+        return 1;
+    }
+
+    // NaN samples become 0 instead of undefined integers
+    float nan[3] = {NAN, NAN, NAN};
+    sil_image_set_pixelf(img, 5, 6, nan);
+    simage_t *rgb = sil_image_new(WIDTH, HEIGHT, SIL_IMAGE_RGB_48);
+    if (!rgb || sil_image_convert_row(img, 6, rgb, 6) != 0
+        || sil_image_get_pixel(rgb, 5, 6) != 0)
+    {
+        perror("[ERROR] convert: NaN not mapped to 0\n");
+        return 1;
+    }
+    sil_image_free(rgb);
+    sil_image_free(img);
+
+    printf("Test convert [OK]\n");
+    return 0;
+}
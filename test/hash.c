@@ -0,0 +1,119 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test checks the content hash ignores storage details and the
+ * perceptual hashes tell similar images from different ones
+ */
+
+#include <sil/simage.h>
+#include <sil/hash.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WIDTH 203
+#define HEIGHT 150
+
+int main()
+{
+    srand(time(NULL));
+
+    simage_t *img = sil_image_new(WIDTH, HEIGHT, SIL_IMAGE_RGB_48);
+    simage_t *crop = sil_image_new(WIDTH, HEIGHT - 20, SIL_IMAGE_RGB_48);
+    if (!img || !crop)
+    {
+        perror("[ERROR] hash: cannot allocate image\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < HEIGHT; ++i)
+    {
+        for (size_t j = 0; j < WIDTH; ++j)
+        {
+            uint64_t color = ((uint64_t) rand() << 32) ^ rand();
+            sil_image_set_pixel(img, j, i, color & 0xffffffffffffULL);
+            if (i >= 10 && i < HEIGHT - 10)
+                sil_image_set_pixel(crop, j, i - 10, color & 0xffffffffffffULL);
+        }
+    }
+
+    uint64_t h = sil_image_hash(img);
+    simage_t *copy = sil_image_copy(img);
+    sil_image_set_order(copy, SIL_IMAGE_ORDER_NATIVE);
+    if (sil_image_hash(copy) != h)
+    {
+        perror("[ERROR] hash: copy hash mismatch\n");
+        return 1;
+    }
+
+    sil_image_set_pixel(copy, 7, 9, sil_image_get_pixel(copy, 7, 9) ^ 1);
+    if (sil_image_hash(copy) == h)
+    {
+        perror("[ERROR] hash: modified image with the same hash\n");
+        return 1;
+    }
+
+    uint64_t h128[2];
+    sil_image_hash128(crop, h128);
+    sil_image_roi(img, 10, 0, WIDTH, HEIGHT - 20);
+    uint64_t roi128[2];
+    sil_image_hash128(img, roi128);
+    if (h128[0] != roi128[0] || h128[1] != roi128[1] || sil_image_hash(crop) != h128[0])
+    {
+        perror("[ERROR] hash: ROI hash mismatch\n");
+        return 1;
+    }
+
+    sil_image_free(copy);
+    sil_image_free(crop);
+    sil_image_free(img);
+
+    // Gradient, the same with noise and the mirrored gradient
+    simage_t *a = sil_image_new(WIDTH, HEIGHT, SIL_IMAGE_GRAY_8);
+    simage_t *b = sil_image_new(WIDTH, HEIGHT, SIL_IMAGE_GRAY_8);
+    simage_t *c = sil_image_new(WIDTH, HEIGHT, SIL_IMAGE_GRAY_8);
+    for (size_t i = 0; i < HEIGHT; ++i)
+    {
+        for (size_t j = 0; j < WIDTH; ++j)
+        {
+            int v = (j * 7 + i * 3 + ((i / 30 + j / 40) % 2) * 60) % 256;
+            sil_image_set_pixel(a, j, i, v);
+            sil_image_set_pixel(b, j, i, v > 4 ? v - rand() % 4 : v);
+            sil_image_set_pixel(c, WIDTH - 1 - j, HEIGHT - 1 - i, v);
+        }
+    }
+
+    if (sil_hash_distance(sil_image_dhash(a), sil_image_dhash(b)) > 8
+        || sil_hash_distance(sil_image_phash(a), sil_image_phash(b)) > 8
+        || sil_hash_distance(sil_image_dhash(a), sil_image_dhash(c)) < 16
+        || sil_hash_distance(sil_image_phash(a), sil_image_phash(c)) < 16)
+    {
+        perror("[ERROR] hash: perceptual hash distance\n");
+        return 1;
+    }
+
+    sil_image_free(c);
+    sil_image_free(b);
+    sil_image_free(a);
+
+    printf("Test hash [OK]\n");
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test builds summed area tables for every supported type and checks
+ * random rectangles against direct sums. The 16-bit images are big enough
+ * to need the 64-bit tables, their whole sum overflows 32 bits.
+ */
+
+#include <sil/simage.h>
+#include <sil/integral.h>
+#include <sil/parallel.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WIDTH 511
+#define HEIGHT 303
+#define QUERIES 500
+
+static const stype_t types[] = {SIL_IMAGE_GRAY_8, SIL_IMAGE_GRAY_16,
+                                SIL_IMAGE_RGB_24, SIL_IMAGE_RGB_48};
+
+static uint32_t sample(const simage_t *img, size_t x, size_t y, size_t c)
+{
+    size_t ch = sil_image_get_channels(img);
+    if (sil_image_get_type(img) == SIL_IMAGE_GRAY_8 || sil_image_get_type(img) == SIL_IMAGE_RGB_24)
+        return sil_image_data_row8(img, y)[x * ch + c];
+    const uint8_t *row = sil_image_data_row8(img, y);
+    return row[2 * (x * ch + c)] << 8 | row[2 * (x * ch + c) + 1];
+}
+
+int main()
+{
+    sil_parallel_init(4, 0);
+    srand(time(NULL));
+
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+    {
+        simage_t *img = sil_image_new(WIDTH, HEIGHT, types[t]);
+        if (!img)
+        {
+            perror("[ERROR] integral: cannot allocate image\n");
+            return 1;
+        }
+        size_t bytes = WIDTH * sil_image_byte_per_pixel(img);
+        for (size_t y = 0; y < HEIGHT; ++y)
+        {
+            uint8_t *row = sil_image_data_row8(img, y);
+            for (size_t i = 0; i < bytes; ++i)
+                row[i] = rand();
+        }
+
+        sintegral_t *table = sil_image_integral(img, 1);
+        if (!table)
+        {
+            perror("[ERROR] integral: table allocation failed\n");
+            sil_image_free(img);
+            return 1;
+        }
+
+        size_t ch = sil_image_get_channels(img);
+        for (size_t q = 0; q < QUERIES; ++q)
+        {
+            size_t x = rand() % WIDTH, y = rand() % HEIGHT;
+            size_t w = rand() % (WIDTH - x + 1), h = rand() % (HEIGHT - y + 1);
+            if (q == 0)
+                x = y = 0, w = WIDTH, h = HEIGHT;
+            size_t c = rand() % ch;
+
+            uint64_t sum = 0, sqsum = 0;
+            for (size_t j = y; j < y + h; ++j)
+                for (size_t i = x; i < x + w; ++i)
+                {
+                    uint64_t s = sample(img, i, j, c);
+                    sum += s;
+                    sqsum += s * s;
+                }
+
+            if (sil_integral_sum(table, c, x, y, w, h) != sum
+                || sil_integral_sqsum(table, c, x, y, w, h) != sqsum)
+            {
+                perror("[ERROR] integral: rectangle sum mismatch\n");
+                sil_integral_free(table);
+                sil_image_free(img);
+                return 1;
+            }
+        }
+
+        sil_integral_free(table);
+        sil_image_free(img);
+    }
+
+    sil_parallel_shutdown();
+    printf("Test integral [OK]\n");
+    return 0;
+}
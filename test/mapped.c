@@ -0,0 +1,119 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test draws random pixels on file backed images and reads the
+ * backing file back as a PNM image
+ */
+
+#include <sil/simage.h>
+#include <sil/pnm.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WIDTH 301
+#define HEIGHT 97
+#define RND_PIX 200
+#define TYPES 4
+
+stype_t types[] = {SIL_IMAGE_GRAY_8,
+                   SIL_IMAGE_GRAY_16,
+                   SIL_IMAGE_RGB_24,
+                   SIL_IMAGE_RGB_48};
+
+static uint64_t get_color(int bpp)
+{
+    uint64_t color = 0;
+    for (int i = 0; i < bpp; ++i)
+        color = (color << 8) | rand() % 0xff;
+    return color;
+}
+
+int main()
+{
+    srand(time(NULL));
+
+    for (int k = 0; k < TYPES; ++k)
+    {
+        char path[] = "/tmp/sil_mappedXXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0)
+        {
+            perror("[ERROR] mapped: cannot create file\n");
+            return 1;
+        }
+        close(fd);
+
+        simage_t *img = sil_image_new_mapped(path, WIDTH, HEIGHT, types[k]);
+        simage_t *ref = sil_image_zero_new(WIDTH, HEIGHT, types[k]);
+        if (!img || !ref)
+        {
+            perror("[ERROR] mapped: cannot allocate image\n");
+            return 1;
+        }
+
+        sil_image_advise(img, 0, HEIGHT, SIL_IMAGE_ADVICE_RANDOM);
+        for (int i = 0; i < RND_PIX; ++i)
+        {
+            size_t x = rand() % WIDTH;
+            size_t y = rand() % HEIGHT;
+            uint64_t color = get_color((int) sil_image_byte_per_pixel(img));
+            sil_image_set_pixel(img, x, y, color);
+            sil_image_set_pixel(ref, x, y, color);
+        }
+
+        if (sil_image_sync(img, 1) != 0)
+        {
+            perror("[ERROR] mapped: cannot sync image\n");
+            return 1;
+        }
+        sil_image_free(img);
+
+        simage_t *back = sil_pnm_read_path(path);
+        if (sil_image_get_type(back) != types[k]
+            || sil_image_get_width(back) != WIDTH
+            || sil_image_get_height(back) != HEIGHT)
+        {
+            perror("[ERROR] mapped: header mismatch\n");
+            return 1;
+        }
+
+        for (size_t i = 0; i < HEIGHT; ++i)
+        {
+            for (size_t j = 0; j < WIDTH; ++j)
+            {
+                if (sil_image_get_pixel(back, j, i) != sil_image_get_pixel(ref, j, i))
+                {
+                    perror("[ERROR] mapped: pixel mismatch\n");
+                    return 1;
+                }
+            }
+        }
+
+        unlink(path);
+        sil_image_free(back);
+        sil_image_free(ref);
+    }
+
+    printf("Test mapped [OK]\n");
+    return 0;
+}
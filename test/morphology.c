@@ -0,0 +1,141 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test checks erosion and dilation with rectangles, lines and masks
+ * against a direct evaluation of every window
+ */
+
+#include <sil/simage.h>
+#include <sil/morphology.h>
+#include <sil/parallel.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WIDTH 157
+#define HEIGHT 203
+
+static const size_t sizes[][2] = {{1, 1}, {3, 3}, {31, 31}, {8, 5}, {1, 17},
+                                  {24, 1}, {300, 2}, {2, 250}};
+
+static uint8_t expected(const simage_t *src, const uint8_t *mask, size_t w, size_t h,
+                        size_t x, size_t y, int dilate)
+{
+    uint8_t value = dilate ? 0 : 255;
+    for (size_t j = 0; j < h; ++j)
+        for (size_t i = 0; i < w; ++i)
+        {
+            long sx = (long) x + (long) i - (long) (w / 2);
+            long sy = (long) y + (long) j - (long) (h / 2);
+            if ((mask && !mask[j * w + i]) || sx < 0 || sy < 0 || sx >= WIDTH || sy >= HEIGHT)
+                continue;
+            uint8_t s = sil_image_data_row8(src, sy)[sx];
+            if (dilate ? s > value : s < value)
+                value = s;
+        }
+    return value;
+}
+
+static int check(const simage_t *src, const simage_t *dst, const uint8_t *mask,
+                 size_t w, size_t h, int dilate)
+{
+    if (!dst)
+    {
+        perror("[ERROR] morphology: cannot allocate output\n");
+        return 0;
+    }
+
+    for (size_t y = 0; y < HEIGHT; ++y)
+        for (size_t x = 0; x < WIDTH; ++x)
+            if (sil_image_data_row8(dst, y)[x] != expected(src, mask, w, h, x, y, dilate))
+            {
+                perror("[ERROR] morphology: wrong output\n");
+                return 0;
+            }
+    return 1;
+}
+
+int main()
+{
+    sil_parallel_init(4, 0);
+    srand(time(NULL));
+
+    simage_t *src = sil_image_new(WIDTH, HEIGHT, SIL_IMAGE_GRAY_8);
+    if (!src)
+    {
+        perror("[ERROR] morphology: cannot allocate image\n");
+        return 1;
+    }
+    for (size_t y = 0; y < HEIGHT; ++y)
+        for (size_t x = 0; x < WIDTH; ++x)
+            sil_image_data_row8(src, y)[x] = rand();
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        size_t w = sizes[s][0], h = sizes[s][1];
+        for (int dilate = 0; dilate < 2; ++dilate)
+        {
+            simage_t *dst = dilate ? sil_image_dilate(src, w, h) : sil_image_erode(src, w, h);
+            if (!check(src, dst, NULL, w, h, dilate))
+                return 1;
+            sil_image_free(dst);
+        }
+
+        // Opening never adds and closing never removes
+        simage_t *open = sil_image_open(src, w, h);
+        simage_t *close = sil_image_close(src, w, h);
+        if (!open || !close)
+        {
+            perror("[ERROR] morphology: cannot allocate output\n");
+            return 1;
+        }
+        for (size_t y = 0; y < HEIGHT; ++y)
+            for (size_t x = 0; x < WIDTH; ++x)
+            {
+                uint8_t v = sil_image_data_row8(src, y)[x];
+                if (sil_image_data_row8(open, y)[x] > v || sil_image_data_row8(close, y)[x] < v)
+                {
+                    perror("[ERROR] morphology: open or close out of bounds\n");
+                    return 1;
+                }
+            }
+        sil_image_free(open);
+        sil_image_free(close);
+    }
+
+    // A plus shaped element through the mask path
+    const uint8_t cross[] = {0, 1, 0, 0,
+                             1, 1, 1, 1,
+                             0, 1, 0, 0};
+    for (int dilate = 0; dilate < 2; ++dilate)
+    {
+        simage_t *dst = dilate ? sil_image_dilate_mask(src, cross, 4, 3)
+                               : sil_image_erode_mask(src, cross, 4, 3);
+        if (!check(src, dst, cross, 4, 3, dilate))
+            return 1;
+        sil_image_free(dst);
+    }
+
+    sil_image_free(src);
+    sil_parallel_shutdown();
+    printf("Test morphology [OK]\n");
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test runs work through the thread pool and checks every item,
+ * row and tile is visited exactly once
+ */
+
+#include <sil/simage.h>
+#include <sil/parallel.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define COUNT 100003
+#define WIDTH 333
+#define HEIGHT 517
+#define SUBMITTERS 4
+
+static int failed;
+
+static void count_items(size_t begin, size_t end, void *ctx)
+{
+    uint8_t *seen = (uint8_t *) ctx;
+    if (end - begin > 100)
+        failed = 1;
+    for (size_t i = begin; i < end; ++i)
+        __atomic_add_fetch(&seen[i], 1, __ATOMIC_RELAXED);
+}
+
+static void nested(size_t begin, size_t end, void *ctx)
+{
+    uint8_t *seen = (uint8_t *) ctx;
+    for (size_t i = begin; i < end; ++i)
+        sil_parallel_for(10, 1, count_items, seen + i * 10);
+}
+
+static void copy_rows(simage_t **imgs, size_t count, size_t top, size_t height, void *ctx)
+{
+    // Band limits must not split a cache line of any image
+    for (size_t i = 0; i < count; ++i)
+        if ((sil_image_get_stride(imgs[i]) * top) % 64 != 0)
+            failed = 1;
+
+    for (size_t y = top; y < top + height; ++y)
+        for (size_t x = 0; x < WIDTH; ++x)
+            sil_image_set_pixel(imgs[1], x, y, sil_image_get_pixel(imgs[0], x, y) + 1);
+}
+
+static void mark_tiles(simage_t **imgs, size_t count, size_t top, size_t left,
+                       size_t width, size_t height, void *ctx)
+{
+    if ((left * sil_image_byte_per_pixel(imgs[0])) % 64 != 0)
+        failed = 1;
+
+    for (size_t y = top; y < top + height; ++y)
+        for (size_t x = left; x < left + width; ++x)
+            sil_image_set_pixel(imgs[0], x, y, sil_image_get_pixel(imgs[0], x, y) + 1);
+}
+
+static void *submit(void *arg)
+{
+    sil_parallel_for(COUNT, 100, count_items, arg);
+    return NULL;
+}
+
+static int all_ones(const uint8_t *seen, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        if (seen[i] != 1)
+            return 0;
+    return 1;
+}
+
+int main()
+{
+    uint8_t *seen = (uint8_t *) calloc(COUNT, 1);
+    sil_parallel_for(COUNT, 100, count_items, seen);
+    if (failed || !all_ones(seen, COUNT))
+    {
+        perror("[ERROR] parallel: items not visited once\n");
+        return 1;
+    }
+
+    // Calls from inside a task must not wait for the pool
+    uint8_t *inner = (uint8_t *) calloc(1000, 1);
+    sil_parallel_for(100, 3, nested, inner);
+    if (!all_ones(inner, 1000))
+    {
+        perror("[ERROR] parallel: nested items not visited once\n");
+        return 1;
+    }
+
+    sil_parallel_init(3, 1);
+    if (sil_parallel_threads() != 3)
+    {
+        perror("[ERROR] parallel: wrong number of threads\n");
+        return 1;
+    }
+
+    // Jobs from several threads run side by side on the pool
+    pthread_t threads[SUBMITTERS];
+    uint8_t *shared = (uint8_t *) calloc(COUNT * SUBMITTERS, 1);
+    for (size_t i = 0; i < SUBMITTERS; ++i)
+        pthread_create(&threads[i], NULL, submit, shared + i * COUNT);
+    for (size_t i = 0; i < SUBMITTERS; ++i)
+        pthread_join(threads[i], NULL);
+    if (failed || !all_ones(shared, COUNT * SUBMITTERS))
+    {
+        perror("[ERROR] parallel: concurrent jobs not visited once\n");
+        return 1;
+    }
+
+    simage_t *imgs[2];
+    imgs[0] = sil_image_zero_new(WIDTH, HEIGHT, SIL_IMAGE_GRAY_8);
+    imgs[1] = sil_image_zero_new(WIDTH, HEIGHT, SIL_IMAGE_RGB_24);
+    for (size_t y = 0; y < HEIGHT; ++y)
+        for (size_t x = 0; x < WIDTH; ++x)
+            sil_image_set_pixel(imgs[0], x, y, (x + y) % 200);
+
+    struct sil_parallel_opts opts = {5, 0, 0};
+    sil_image_parallel_rows(imgs, 2, copy_rows, NULL, &opts);
+    for (size_t y = 0; y < HEIGHT; ++y)
+        for (size_t x = 0; x < WIDTH; ++x)
+            if (sil_image_get_pixel(imgs[1], x, y) != (x + y) % 200 + 1)
+                failed = 1;
+    if (failed)
+    {
+        perror("[ERROR] parallel: wrong row bands\n");
+        return 1;
+    }
+
+    sil_image_zero(imgs[1]);
+    sil_image_parallel_tiles(imgs + 1, 1, mark_tiles, NULL, NULL);
+    for (size_t y = 0; y < HEIGHT; ++y)
+        for (size_t x = 0; x < WIDTH; ++x)
+            if (sil_image_get_pixel(imgs[1], x, y) != 1)
+                failed = 1;
+    if (failed)
+    {
+        perror("[ERROR] parallel: wrong tiles\n");
+        return 1;
+    }
+
+    sil_parallel_shutdown();
+    sil_image_free(imgs[0]);
+    sil_image_free(imgs[1]);
+    free (shared);
+    free (inner);
+    free (seen);
+
+    printf("Test parallel [OK]\n");
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test writes images with the parallel writer, with and without
+ * O_DIRECT, and compares them with the serial writer output
+ */
+
+#include <sil/simage.h>
+#include <sil/pnm.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WIDTH 1031
+#define HEIGHT 1500
+#define TYPES 3
+
+stype_t types[] = {SIL_IMAGE_GRAY_8,
+                   SIL_IMAGE_RGB_48,
+                   SIL_IMAGE_RGBA_32};
+
+static int same_file(FILE *a, FILE *b)
+{
+    rewind(a);
+    rewind(b);
+
+    int ca, cb;
+    do
+    {
+        ca = fgetc(a);
+        cb = fgetc(b);
+        if (ca != cb)
+            return 0;
+    }
+    while (ca != EOF);
+    return 1;
+}
+
+int main()
+{
+    srand(time(NULL));
+
+    for (int k = 0; k < TYPES; ++k)
+    {
+        simage_t *img = sil_image_new(WIDTH, HEIGHT, types[k]);
+        if (!img)
+        {
+            perror("[ERROR] parallel_write: cannot allocate image\n");
+            return 1;
+        }
+
+        size_t bytes = WIDTH * sil_image_byte_per_pixel(img);
+        for (size_t i = 0; i < HEIGHT; ++i)
+        {
+            uint8_t *row = sil_image_data_row8(img, i);
+            for (size_t j = 0; j < bytes; ++j)
+                row[j] = rand();
+        }
+
+        FILE *serial = tmpfile();
+        sil_pnm_write_stream(img, serial);
+
+        for (int flags = 0; flags <= SIL_PNM_DIRECT; ++flags)
+        {
+            char path[] = "/tmp/sil_parallelXXXXXX";
+            int fd = mkstemp(path);
+            if (fd < 0)
+            {
+                perror("[ERROR] parallel_write: cannot create file\n");
+                return 1;
+            }
+            close(fd);
+
+            sil_pnm_write_path_parallel(img, path, 4, flags);
+
+            FILE *parallel = fopen(path, "r");
+            if (!parallel || !same_file(serial, parallel))
+            {
+                perror("[ERROR] parallel_write: file mismatch\n");
+                return 1;
+            }
+            fclose(parallel);
+            unlink(path);
+        }
+
+        fclose(serial);
+        sil_image_free(img);
+    }
+
+    printf("Test parallel_write [OK]\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * This file is part of SIL a Simple Image Library.
+ * Copyright (C) 2016  Felipe A. Ortiz C. <fortizc@gmail.com>
+ *
+ * SIL is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SIL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with SIL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This test writes an image, patches some bands in place and checks the
+ * file against the same changes done in memory
+ */
+
+#include <sil/simage.h>
+#include <sil/pnm.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WIDTH 61
+#define HEIGHT 90
+#define TYPES 2
+
+stype_t types[] = {SIL_IMAGE_GRAY_8,
+                   SIL_IMAGE_RGB_48};
+
+static uint64_t get_color(int bpp)
+{
+    uint64_t color = 0;
+    for (int i = 0; i < bpp; ++i)
+        color = (color << 8) | rand() % 0xff;
+    return color;
+}
+
+static void fill(simage_t *ref, supdate_t *u, size_t top, size_t left, size_t width, size_t height)
+{
+    simage_t *img = sil_pnm_update_image(u);
+    for (size_t i = top; i < top + height; ++i)
+    {
+        for (size_t j = left; j < left + width; ++j)
+        {
+            uint64_t color = get_color((int) sil_image_byte_per_pixel(img));
+            sil_image_set_pixel(img, j, i, color);
+            sil_image_set_pixel(ref, j, i, color);
+        }
+    }
+}
+
+int main()
+{
+    srand(time(NULL));
+
+    for (int k = 0; k < TYPES; ++k)
+    {
+        char path[] = "/tmp/sil_updateXXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0)
+        {
+            perror("[ERROR] update: cannot create file\n");
+            return 1;
+        }
+        close(fd);
+
+        simage_t *ref = sil_image_new(WIDTH, HEIGHT, types[k]);
+        if (!ref)
+        {
+            perror("[ERROR] update: cannot allocate image\n");
+            return 1;
+        }
+        for (size_t i = 0; i < HEIGHT; ++i)
+            for (size_t j = 0; j < WIDTH; ++j)
+                sil_image_set_pixel(ref, j, i, get_color((int) sil_image_byte_per_pixel(ref)));
+        sil_pnm_write_path(ref, path);
+
+        supdate_t *u = sil_pnm_update_open(path);
+
+        // A partial band, loaded first so untouched bytes stay valid
+        sil_pnm_update_load(u, 10, 5);
+        fill(ref, u, 10, 7, 13, 5);
+        sil_pnm_update_mark(u, 10, 7, 13, 5);
+
+        // Separate marks on rows never loaded, in both orders
+        fill(ref, u, 70, 2, 3, 1);
+        sil_pnm_update_mark(u, 70, 2, 3, 1);
+        fill(ref, u, 70, 50, 4, 1);
+        sil_pnm_update_mark(u, 70, 50, 4, 1);
+        fill(ref, u, 75, 45, 6, 2);
+        sil_pnm_update_mark(u, 75, 45, 6, 2);
+        fill(ref, u, 75, 1, 2, 2);
+        sil_pnm_update_mark(u, 75, 1, 2, 2);
+
+        // Full rows, written without loading
+        fill(ref, u, 40, 0, WIDTH, 20);
+        sil_pnm_update_mark_rows(u, 40, 20);
+        sil_pnm_update_commit(u);
+
+        fill(ref, u, HEIGHT - 1, 0, WIDTH, 1);
+        sil_pnm_update_mark_rows(u, HEIGHT - 1, 1);
+        sil_pnm_update_close(u);
+
+        simage_t *back = sil_pnm_read_path(path);
+        for (size_t i = 0; i < HEIGHT; ++i)
+        {
+            for (size_t j = 0; j < WIDTH; ++j)
+            {
+                if (sil_image_get_pixel(back, j, i) != sil_image_get_pixel(ref, j, i))
+                {
+                    perror("[ERROR] update: pixel mismatch\n");
+                    return 1;
+                }
+            }
+        }
+
+        unlink(path);
+        sil_image_free(back);
+        sil_image_free(ref);
+    }
+
+    printf("Test update [OK]\n");
+    return 0;
+}
@@ -32,12 +32,13 @@
 #define WIDTH 20
 #define HEIGHT 20
 #define RND_PIX 30
-#define TYPES 4
+#define TYPES 5
 
 stype_t types[] = {SIL_IMAGE_GRAY_8,
                    SIL_IMAGE_GRAY_16,
                    SIL_IMAGE_RGB_24,
-                   SIL_IMAGE_RGB_48};
+                   SIL_IMAGE_RGB_48,
+                   SIL_IMAGE_RGBA_32};
 
 static uint64_t get_color(int bpp)
 {
@@ -26,18 +26,25 @@
 
 #include <stdio.h>
 
-#define TYPES 4
+#define TYPES 7
+#define SIZES 2
 
 stype_t types[] = {SIL_IMAGE_GRAY_8,
                    SIL_IMAGE_GRAY_16,
                    SIL_IMAGE_RGB_24,
-                   SIL_IMAGE_RGB_48};
+                   SIL_IMAGE_RGB_48,
+                   SIL_IMAGE_RGBA_32,
+                   SIL_IMAGE_GRAY_32F,
+                   SIL_IMAGE_RGB_96F};
+
+// Large zeroed images are backed by lazily zeroed pages
+size_t sizes[] = {20, 700};
 
 int main()
 {
-    for (int k = 0; k < TYPES; ++k)
+    for (int k = 0; k < TYPES * SIZES; ++k)
     {
-        simage_t *img = sil_image_zero_new(20, 20, types[k]);
+        simage_t *img = sil_image_zero_new(sizes[k / TYPES], sizes[k / TYPES], types[k % TYPES]);
 
         if (!img)
         {